@@ -0,0 +1,236 @@
+// bench.cpp — benchmarks de latencia de las tres herramientas con percentiles y salida JSON.
+// Casos: parseo de ticks CSV y .tka (process_market), agrupado + VWAP/spread, fit_line_lastk_at_t y
+// solve_linear (get_nowcast), inferencia de 1 fila y por batch (mlp_infer_plain).
+// Cada caso hace warmup, luego junta muestras (una por llamada o por repeticion) y reporta
+// min/p50/p90/p99/p99.9/max/mean en ns mas un histograma en buckets potencia de 2.
+#include <bits/stdc++.h>
+#include <filesystem>
+#include "market_core.hpp"
+#include "nowcast_core.hpp"
+#include "mlp_core.hpp"
+#include "latency.hpp"
+using namespace std;
+namespace fs = std::filesystem;
+
+struct BenchOpts {
+    int warmup = 3;
+    int reps = 20;          // repeticiones de casos "por batch"
+    int calls = 100000;     // muestras de casos "por llamada"
+    int rows = 200000;      // ticks sinteticos
+    int pin_cpu = -1;
+    string bundle = "mlp_bundle.txt";
+    string market_csv;      // si se pasa, se usa en vez de ticks sinteticos
+    string filter;
+    string out;             // vacio -> stdout
+};
+
+struct BenchResult {
+    string name;
+    string unit = "ns";
+    long long items_per_sample = 1;
+    vector<double> samples;  // ns
+};
+
+// destino de los resultados para que el compilador no elimine las llamadas medidas
+static volatile double g_sink = 0.0;
+
+// Escapa un string para meterlo entre comillas en el JSON (paths con \ o ").
+static string json_escape(const string& s){
+    string o;
+    for(char c: s){
+        if(c=='"' || c=='\\'){ o += '\\'; o += c; }
+        else if((unsigned char)c < 0x20){ char b[8]; snprintf(b, sizeof b, "\\u%04x", c); o += b; }
+        else o += c;
+    }
+    return o;
+}
+
+// Ticks sinteticos con la forma de market_data/: fecha_nano,price,quantity,side
+static string write_synthetic_ticks(int rows){
+    string path = (fs::temp_directory_path() / ("bench_ticks_" + to_string(chrono::steady_clock::now().time_since_epoch().count()) + ".csv")).string();
+    ofstream f(path);
+    f<<"fecha_nano,price,quantity,side\n";
+    mt19937_64 rng(7);
+    uniform_int_distribution<int> dt(1, 50), q(1, 500), side(0, 3), rep(1, 3);
+    normal_distribution<double> ret(0.0, 1e-4);
+    const char* sides[] = {"BI","OF","TRADE","TRADE"};
+    long long t = 1715526000000000000LL;
+    double p = 1141.5;
+    f.setf(std::ios::fixed); f<<setprecision(2);
+    for(int i=0;i<rows;){
+        t += dt(rng)*10000000LL;
+        p = round(p*(1.0+ret(rng))*100.0)/100.0;
+        const char* s = sides[side(rng)];
+        for(int k=rep(rng); k>0 && i<rows; --k, ++i) f<<t<<","<<p<<","<<q(rng)<<","<<s<<"\n";
+    }
+    return path;
+}
+
+int main(int argc, char** argv){
+    BenchOpts opt;
+    for(int i=1;i<argc;i++){
+        string a = argv[i];
+        auto need=[&](const char* name){ if(i+1>=argc){ cerr<<"Falta valor para "<<name<<"\n"; exit(1);} return string(argv[++i]); };
+        if(a=="--warmup") opt.warmup = stoi(need("--warmup"));
+        else if(a=="--reps") opt.reps = stoi(need("--reps"));
+        else if(a=="--calls") opt.calls = stoi(need("--calls"));
+        else if(a=="--rows") opt.rows = stoi(need("--rows"));
+        else if(a=="--pin") opt.pin_cpu = stoi(need("--pin"));
+        else if(a=="--bundle") opt.bundle = need("--bundle");
+        else if(a=="--market_csv") opt.market_csv = need("--market_csv");
+        else if(a=="--filter") opt.filter = need("--filter");
+        else if(a=="--out") opt.out = need("--out");
+        else { cerr<<"Arg desconocido: "<<a<<"\n"; return 1; }
+    }
+    // cada caso necesita al menos una muestra (min/max/percentiles del JSON)
+    if(opt.reps<=0 || opt.calls<=0 || opt.rows<=0){ cerr<<"--reps, --calls y --rows deben ser > 0\n"; return 1; }
+    if(opt.warmup<0){ cerr<<"--warmup debe ser >= 0\n"; return 1; }
+    bool pinned = false;
+    if(opt.pin_cpu>=0){
+        pinned = pin_to_cpu(opt.pin_cpu);
+        if(!pinned) cerr<<"[WARN] no se pudo fijar la CPU "<<opt.pin_cpu<<"\n";
+    }
+
+    vector<BenchResult> results;
+    auto enabled = [&](const string& name){ return opt.filter.empty() || name.find(opt.filter)!=string::npos; };
+    // f() es una muestra; se corre warmup veces sin registrar y luego n veces
+    auto run = [&](const string& name, int n, long long items, const function<void()>& f){
+        if(!enabled(name)) return;
+        for(int i=0;i<opt.warmup;++i) f();
+        BenchResult r; r.name = name; r.items_per_sample = items;
+        r.samples.reserve(n);
+        for(int i=0;i<n;++i){
+            const int64_t t0 = now_ns();
+            f();
+            r.samples.push_back((double)(now_ns() - t0));
+        }
+        cerr<<"  "<<name<<": "<<n<<" muestras\n";
+        results.push_back(move(r));
+    };
+
+    // ---- process_market ----
+    bool tmp_csv = opt.market_csv.empty();
+    string csv = tmp_csv? write_synthetic_ticks(opt.rows) : opt.market_csv;
+    vector<RawRow> rows;
+    if(!read_csv_minimal(csv, rows) || rows.empty()){ cerr<<"No pude leer "<<csv<<"\n"; return 1; }
+    run("process_market.read_csv_minimal", opt.reps, (long long)rows.size(), [&]{
+        vector<RawRow> tmp; tmp.reserve(rows.size());
+        read_csv_minimal(csv, tmp);
+        g_sink = g_sink + tmp.size();
+    });
+    {
+        // mismo archivo en formato .tka (tick_archive.hpp)
+        string tka = (fs::temp_directory_path() / ("bench_ticks_" + to_string(chrono::steady_clock::now().time_since_epoch().count()) + ".tka")).string();
+        string err;
+        if(write_tka(tka, rows, err)){
+            run("process_market.read_tka", opt.reps, (long long)rows.size(), [&]{
+                vector<RawRow> tmp;
+                read_tka(tka, tmp);
+                g_sink = g_sink + tmp.size();
+            });
+            fs::remove(tka);
+        }else cerr<<"[WARN] read_tka omitido: "<<err<<"\n";
+    }
+    run("process_market.group_metrics", opt.reps, (long long)rows.size(), [&]{
+        for(const char* s: {"BI","OF","TRADE"}){
+            auto g = build_df_for_side(rows, s);
+            for(const auto& gr: g) g_sink = g_sink + make_metric("X", gr).vwap;
+        }
+    });
+    if(tmp_csv) fs::remove(csv);
+
+    // ---- get_nowcast ----
+    vector<TP> series;
+    for(const auto& r: rows) if(r.side=="TRADE"){
+        double t = r.fecha_nano/1e9;
+        if(!series.empty() && fabs(series.back().t - t) < 1e-9) series.back() = {t, r.price};
+        else series.push_back({t, r.price});
+    }
+    if(series.size()<10){ cerr<<"Muy pocos TRADE para el bench\n"; return 1; }
+    {
+        mt19937_64 rng(11);
+        uniform_int_distribution<size_t> pick(5, series.size()-1);
+        vector<double> ts(opt.calls);
+        for(auto& t: ts) t = series[pick(rng)].t;
+        size_t i = 0;
+        run("get_nowcast.fit_line_lastk_at_t(k=3)", opt.calls, 1, [&]{
+            double yh, m;
+            if(fit_line_lastk_at_t(series, ts[i++ % ts.size()], 3, yh, m)) g_sink = g_sink + m;
+        });
+    }
+    {
+        // ecuaciones normales d=10 (5 instrumentos x (p, m)) sobre features aleatorias
+        const int d = 10;
+        mt19937_64 rng(13);
+        normal_distribution<double> N01;
+        vector<vector<double>> A0(d, vector<double>(d, 0.0));
+        vector<double> b0(d, 0.0), x(d);
+        for(int s=0;s<1000;++s){
+            for(auto& v: x) v = N01(rng);
+            double yv = N01(rng);
+            for(int i=0;i<d;++i){ b0[i] += x[i]*yv; for(int j=0;j<d;++j) A0[i][j] += x[i]*x[j]; }
+        }
+        vector<vector<double>> A; vector<double> b, beta;
+        run("get_nowcast.solve_linear(d=10)", opt.calls, 1, [&]{
+            A = A0; b = b0;
+            solve_linear(A, b, beta);
+            g_sink = g_sink + beta[0];
+        });
+    }
+
+    // ---- mlp_infer_plain ----
+    if(fs::exists(opt.bundle)){
+        Bundle B = load_bundle_txt(opt.bundle);
+        const int nf = B.n_features;
+        mt19937_64 rng(17);
+        vector<double> Xb((size_t)4096*nf);
+        for(size_t i=0;i<Xb.size();++i){
+            int c = (int)(i % nf);
+            Xb[i] = B.scaler_mean[c] + B.scaler_scale[c]*normal_distribution<double>()(rng);
+        }
+        vector<double> x1(Xb.begin(), Xb.begin()+nf);
+        for(ActImpl impl: {ActImpl::Libm, ActImpl::Fast}){
+            string tag = impl==ActImpl::Libm? "libm" : "fast";
+            run("mlp.predict_single_row[" + tag + "]", opt.calls, 1, [&]{ g_sink = g_sink + mlp_predict(B, x1, 1, impl)[0]; });
+            run("mlp.predict_batch4096[" + tag + "]", opt.reps, 4096, [&]{ g_sink = g_sink + mlp_predict(B, Xb, 4096, impl)[0]; });
+        }
+    }else{
+        cerr<<"[WARN] no existe "<<opt.bundle<<", se omiten los casos mlp.*\n";
+    }
+
+    // ---- JSON ----
+    ostringstream js;
+    js.setf(std::ios::fixed); js<<setprecision(1);
+    js<<"{\n";
+    js<<"  \"config\": {\"warmup\": "<<opt.warmup<<", \"reps\": "<<opt.reps<<", \"calls\": "<<opt.calls
+      <<", \"rows\": "<<rows.size()<<", \"pin_cpu\": "<<(pinned? opt.pin_cpu : -1)
+      <<", \"bundle\": \""<<json_escape(opt.bundle)<<"\", \"market_csv\": \""<<(tmp_csv? "synthetic" : json_escape(opt.market_csv))<<"\"},\n";
+    js<<"  \"results\": [\n";
+    for(size_t k=0;k<results.size();++k){
+        auto& r = results[k];
+        sort(r.samples.begin(), r.samples.end());
+        double mean = accumulate(r.samples.begin(), r.samples.end(), 0.0) / r.samples.size();
+        // histograma: bucket i cuenta muestras en [2^i, 2^(i+1)) ns
+        map<int,long long> hist;
+        for(double s: r.samples) hist[s<1.0? 0 : (int)floor(log2(s))]++;
+        js<<"    {\"name\": \""<<json_escape(r.name)<<"\", \"unit\": \""<<r.unit<<"\", \"samples\": "<<r.samples.size()
+          <<", \"items_per_sample\": "<<r.items_per_sample
+          <<", \"min\": "<<r.samples.front()<<", \"p50\": "<<pct(r.samples,50)<<", \"p90\": "<<pct(r.samples,90)
+          <<", \"p99\": "<<pct(r.samples,99)<<", \"p99_9\": "<<pct(r.samples,99.9)<<", \"max\": "<<r.samples.back()
+          <<", \"mean\": "<<mean<<", \"ns_per_item_p50\": "<<pct(r.samples,50)/r.items_per_sample
+          <<", \"hist_log2_ns\": {";
+        bool first = true;
+        for(auto& kv: hist){ js<<(first? "":", ")<<"\""<<kv.first<<"\": "<<kv.second; first = false; }
+        js<<"}}"<<(k+1<results.size()? ",":"")<<"\n";
+    }
+    js<<"  ]\n}\n";
+
+    if(opt.out.empty()) cout<<js.str();
+    else {
+        ofstream f(opt.out);
+        if(!f){ cerr<<"No se pudo abrir "<<opt.out<<"\n"; return 1; }
+        f<<js.str();
+        cerr<<"Resultados en: "<<opt.out<<"\n";
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+// csv_util.hpp — parsing CSV minimo compartido por las herramientas.
+#pragma once
+#include <bits/stdc++.h>
+using namespace std;
+
+static const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+// Escribe una linea entera a stderr bajo un mutex: process_market --root lee particiones en hilos
+// y los avisos de lectura (read_csv_minimal, read_tka, load_market_files) no deben mezclarse.
+static inline void log_err(const string& line) {
+    static mutex mu;
+    lock_guard<mutex> lk(mu);
+    cerr << line << '\n';
+}
+
+/* ---------------- CSV utils ---------------- */
+static inline vector<string> split_csv(const string& s, char delim=',') {
+    vector<string> out; out.reserve(16);
+    string cur; cur.reserve(s.size());
+    bool in_quotes = false;
+    for (char c : s) {
+        if (c == '"') { in_quotes = !in_quotes; continue; }
+        if (!in_quotes && c == delim) { out.push_back(cur); cur.clear(); }
+        else cur.push_back(c);
+    }
+    out.push_back(cur);
+    return out;
+}
+static inline string trim(const string& s) {
+    size_t a = s.find_first_not_of(" \t\r\n");
+    if (a == string::npos) return "";
+    size_t b = s.find_last_not_of(" \t\r\n");
+    return s.substr(a, b - a + 1);
+}
+static inline bool to_double(const string& s, double& x) {
+    string t = trim(s);
+    if (t.empty()) { x = NaN; return false; }
+    try { x = stod(t); return true; }
+    catch(...) { x = NaN; return false; }
+}
+static inline bool to_int64(const string& s, long long& x) {
+    string t = trim(s);
+    if (t.empty()) { x = 0; return false; }
+    try { x = stoll(t); return true; }
+    catch(...) { x = 0; return false; }
+}
@@ -0,0 +1,141 @@
+// drift_monitor.hpp — metricas online del modelo a medida que llega el y realizado.
+// O(1) por update y memoria fija (ventana de W errores), sin guardar la historia:
+//   - ventana movil de W predicciones: MSE, R², sesgo (media de yhat - y)
+//   - EWMA con vida media H: MSE, R² (contra la varianza EW de y), sesgo
+//   - cuantiles p50/p90/p99 de |yhat - y| del ultimo periodo (P², Jain & Chlamtac 1985)
+//   - mse_vs_ref: MSE de la ventana / MSE de la primera ventana completa (>1 = el modelo empeoro)
+// Cada `every` updates escribe una linea "[drift] clave=valor ..." y reinicia los cuantiles.
+#pragma once
+#include "csv_util.hpp"
+
+struct DriftOpts {
+    long long every = 0;      // 0 = monitor apagado
+    int window = 1000;
+    double halflife = 500.0;  // en predicciones
+};
+
+// Cuantil p sin guardar las muestras: 5 marcadores con ajuste parabolico.
+class P2Quantile {
+public:
+    explicit P2Quantile(double p = 0.5): p_(p) { reset(); }
+    void reset(){
+        n_obs_ = 0;
+        const double init_np[5] = {1, 1 + 2*p_, 1 + 4*p_, 3 + 2*p_, 5};
+        const double init_dn[5] = {0, p_/2, p_, (1 + p_)/2, 1};
+        for(int i=0;i<5;++i){ n_[i] = i + 1; np_[i] = init_np[i]; dn_[i] = init_dn[i]; }
+    }
+    void add(double x){
+        if(n_obs_ < 5){
+            // insercion ordenada en los primeros 5
+            int i = (int)n_obs_++;
+            for(; i>0 && q_[i-1] > x; --i) q_[i] = q_[i-1];
+            q_[i] = x;
+            return;
+        }
+        ++n_obs_;
+        int k;
+        if(x < q_[0]){ q_[0] = x; k = 0; }
+        else if(x >= q_[4]){ q_[4] = x; k = 3; }
+        else { k = 0; while(x >= q_[k+1]) ++k; }
+        for(int i=k+1;i<5;++i) n_[i] += 1;
+        for(int i=0;i<5;++i) np_[i] += dn_[i];
+        for(int i=1;i<4;++i){
+            const double d = np_[i] - n_[i];
+            if((d >= 1 && n_[i+1] - n_[i] > 1) || (d <= -1 && n_[i-1] - n_[i] < -1)){
+                const int s = d > 0? 1 : -1;
+                double qp = q_[i] + (double)s / (n_[i+1] - n_[i-1]) *
+                            ((n_[i] - n_[i-1] + s) * (q_[i+1] - q_[i]) / (n_[i+1] - n_[i]) +
+                             (n_[i+1] - n_[i] - s) * (q_[i] - q_[i-1]) / (n_[i] - n_[i-1]));
+                if(!(q_[i-1] < qp && qp < q_[i+1]))   // fuera de orden: interpolacion lineal
+                    qp = q_[i] + s * (q_[i+s] - q_[i]) / (n_[i+s] - n_[i]);
+                q_[i] = qp;
+                n_[i] += s;
+            }
+        }
+    }
+    double value() const {
+        if(n_obs_ == 0) return NaN;
+        if(n_obs_ < 5) return q_[llround(p_ * (n_obs_ - 1))];   // q_ ya esta ordenado
+        return q_[2];
+    }
+private:
+    double p_;
+    long long n_obs_;
+    double q_[5], np_[5], dn_[5];
+    int n_[5];
+};
+
+class DriftMonitor {
+public:
+    DriftMonitor(const DriftOpts& o, ostream& out)
+        : opt_(o), out_(out), ring_y_(max(1, o.window)), ring_e_(max(1, o.window)),
+          alpha_(1.0 - exp(-log(2.0) / max(1e-9, o.halflife))), ae_{P2Quantile(0.5), P2Quantile(0.9), P2Quantile(0.99)} {}
+
+    void add(double y, double yhat){
+        const double e = yhat - y;
+        // ventana: suma las nuevas, resta las que salen; cada W updates se recalcula para no
+        // acumular error de redondeo (amortizado O(1))
+        const size_t W = ring_y_.size();
+        if(n_ >= (long long)W){
+            const double yo = ring_y_[pos_], eo = ring_e_[pos_];
+            sy_ -= yo; syy_ -= yo*yo; se_ -= eo; see_ -= eo*eo;
+        }
+        ring_y_[pos_] = y; ring_e_[pos_] = e;
+        sy_ += y; syy_ += y*y; se_ += e; see_ += e*e;
+        if(++pos_ == W){
+            pos_ = 0;
+            sy_ = syy_ = se_ = see_ = 0.0;
+            for(size_t i=0;i<W;++i){
+                sy_ += ring_y_[i]; syy_ += ring_y_[i]*ring_y_[i];
+                se_ += ring_e_[i]; see_ += ring_e_[i]*ring_e_[i];
+            }
+        }
+        ++n_;
+        if(n_ == (long long)W) ref_mse_ = see_ / W;
+
+        // EWMA (media/varianza exponencial incremental para y)
+        if(n_ == 1){ ew_y_ = y; ew_vy_ = 0.0; ew_e_ = e; ew_ee_ = e*e; }
+        else {
+            const double dy = y - ew_y_, inc = alpha_ * dy;
+            ew_y_ += inc;
+            ew_vy_ = (1.0 - alpha_) * (ew_vy_ + dy * inc);
+            ew_e_ += alpha_ * (e - ew_e_);
+            ew_ee_ += alpha_ * (e*e - ew_ee_);
+        }
+
+        for(auto& q: ae_) q.add(fabs(e));
+        if(opt_.every > 0 && n_ % opt_.every == 0) report();
+    }
+
+    // Escribe la linea con el estado actual y reinicia los cuantiles del periodo.
+    void report(){
+        if(n_ == 0) return;
+        const double w = (double)min<long long>(n_, (long long)ring_y_.size());
+        const double win_mse = see_ / w;
+        const double sst = syy_ - sy_*sy_ / w;
+        const double win_r2 = sst > 0? 1.0 - see_ / sst : NaN;
+        const double ew_r2 = ew_vy_ > 0? 1.0 - ew_ee_ / ew_vy_ : NaN;
+        char buf[512];
+        snprintf(buf, sizeof buf,
+                 "[drift] n=%lld win_mse=%.6g win_r2=%.4f win_bias=%.6g ewma_mse=%.6g ewma_r2=%.4f ewma_bias=%.6g"
+                 " ae_p50=%.6g ae_p90=%.6g ae_p99=%.6g mse_vs_ref=%.3f\n",
+                 n_, win_mse, win_r2, se_ / w, ew_ee_, ew_r2, ew_e_,
+                 ae_[0].value(), ae_[1].value(), ae_[2].value(), ref_mse_ > 0? win_mse / ref_mse_ : NaN);
+        out_ << buf << flush;
+        for(auto& q: ae_) q.reset();
+    }
+
+    long long count() const { return n_; }
+
+private:
+    DriftOpts opt_;
+    ostream& out_;
+    vector<double> ring_y_, ring_e_;
+    size_t pos_ = 0;
+    long long n_ = 0;
+    double sy_ = 0, syy_ = 0, se_ = 0, see_ = 0;
+    double ref_mse_ = NaN;
+    double alpha_;
+    double ew_y_ = 0, ew_vy_ = 0, ew_e_ = 0, ew_ee_ = 0;
+    P2Quantile ae_[3];
+};
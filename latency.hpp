@@ -0,0 +1,31 @@
+// latency.hpp — reloj en ns, percentiles y afinidad de CPU para bench y replay.
+#pragma once
+#include <bits/stdc++.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+using namespace std;
+
+// entero: como double se pierde la resolucion de 1 ns pasados ~104 dias de uptime (2^53 ns);
+// restar en int64_t y convertir solo la diferencia
+static inline int64_t now_ns(){
+    return (int64_t)chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// percentil nearest-rank sobre muestras ordenadas
+static inline double pct(const vector<double>& s, double p){
+    if(s.empty()) return numeric_limits<double>::quiet_NaN();
+    size_t k = (size_t)ceil(p/100.0 * s.size());
+    if(k==0) k = 1;
+    return s[min(k, s.size()) - 1];
+}
+
+static inline bool pin_to_cpu(int cpu){
+#ifdef __linux__
+    cpu_set_t set; CPU_ZERO(&set); CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set)==0;
+#else
+    (void)cpu; return false;
+#endif
+}
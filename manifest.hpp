@@ -0,0 +1,57 @@
+// manifest.hpp — indice de particiones de process_market --root (manifest.csv).
+// Una fila por (date, instrument, side): rango de filas y de bytes dentro del df_all.csv de la
+// particion (ordenado por instrument, side, fecha_nano), min/max fecha_nano y la firma de los
+// archivos fuente de la particion, que process_market usa para saltear las que estan al dia.
+// file es relativo al directorio del manifest. Una particion sin filas tiene una unica entrada con
+// instrument y side vacios (rango 0/0) que guarda su firma.
+#pragma once
+#include "csv_util.hpp"
+
+static const char* MANIFEST_HEADER =
+    "date,instrument,side,file,row_begin,row_end,byte_begin,byte_end,min_ts,max_ts,source_sig\n";
+
+struct ManifestEntry {
+    string date, instrument, side, file;
+    long long row_begin = 0, row_end = 0;     // [begin, end) sin contar el header
+    long long byte_begin = 0, byte_end = 0;   // [begin, end) en el archivo
+    long long min_ts = 0, max_ts = 0;
+    string source_sig;
+};
+
+static inline bool read_manifest(const string& path, vector<ManifestEntry>& out){
+    ifstream fin(path);
+    if(!fin) return false;
+    string line;
+    if(!getline(fin, line)) return false;
+    if(line + "\n" != MANIFEST_HEADER){ cerr<<"Header inesperado en "<<path<<"\n"; return false; }
+    while(getline(fin, line)){
+        if(trim(line).empty()) continue;
+        auto t = split_csv(line);
+        if(t.size() != 11){ cerr<<"Fila invalida en "<<path<<": "<<line<<"\n"; return false; }
+        ManifestEntry e;
+        e.date = t[0]; e.instrument = t[1]; e.side = t[2]; e.file = t[3];
+        bool ok = to_int64(t[4], e.row_begin) & to_int64(t[5], e.row_end)
+                & to_int64(t[6], e.byte_begin) & to_int64(t[7], e.byte_end)
+                & to_int64(t[8], e.min_ts) & to_int64(t[9], e.max_ts);
+        if(!ok){ cerr<<"Fila invalida en "<<path<<": "<<line<<"\n"; return false; }
+        e.source_sig = trim(t[10]);
+        out.push_back(move(e));
+    }
+    return true;
+}
+
+// Escribe en un temporal y renombra: un lector nunca ve el manifest a medias.
+static inline bool write_manifest(const string& path, const vector<ManifestEntry>& entries){
+    const string tmp = path + ".tmp";
+    {
+        ofstream fout(tmp);
+        if(!fout) return false;
+        fout << MANIFEST_HEADER;
+        for(const auto& e: entries)
+            fout << e.date << "," << e.instrument << "," << e.side << "," << e.file << ","
+                 << e.row_begin << "," << e.row_end << "," << e.byte_begin << "," << e.byte_end << ","
+                 << e.min_ts << "," << e.max_ts << "," << e.source_sig << "\n";
+        if(!fout) return false;
+    }
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,356 @@
+// market_core.hpp — lectura de ticks, agrupado por timestamp/side y VWAP/spread (process_market).
+#pragma once
+#include <filesystem>
+#include "csv_util.hpp"
+#include "trace.hpp"
+#include "tick_archive.hpp"
+
+/* ---------------- Data structs ---------------- */
+struct RawRow {
+    long long fecha_nano; // ns epoch
+    double price;
+    double quantity;
+    string side;
+};
+
+struct GroupRow {
+    long long fecha_nano;
+    string side;
+    vector<double> prices;
+    vector<double> quantities;
+};
+
+struct MetricRow {
+    string instrument;
+    string side;
+    long long fecha_nano;
+    double ts_sec;   // fecha_nano / 1e9
+    double vwap;
+    double spread;   // sqrt(var_ponderada)
+    double qty;      // suma de cantidades validas del grupo (peso del vwap)
+};
+
+/* ---------------- IO ---------------- */
+static inline bool read_csv_minimal(const string& path,
+                                    vector<RawRow>& out_rows) {
+    TRACE_SCOPE("read_csv");
+    ifstream fin(path);
+    if (!fin) return false;
+
+    string header;
+    if (!getline(fin, header)) return false;
+
+    auto cols = split_csv(header);
+    for (auto& c : cols) c = trim(c);
+
+    // map columnas -> índice
+    int idx_fecha = -1, idx_price = -1, idx_qty = -1, idx_side = -1;
+    for (int i=0;i<(int)cols.size();++i) {
+        if (cols[i] == "fecha_nano") idx_fecha = i;
+        else if (cols[i] == "price") idx_price = i;
+        else if (cols[i] == "quantity") idx_qty = i;
+        else if (cols[i] == "side") idx_side = i;
+    }
+    if (idx_fecha<0 || idx_price<0 || idx_qty<0 || idx_side<0) {
+        log_err("Faltan columnas en: " + path);
+        return false;
+    }
+
+    const size_t n0 = out_rows.size();
+    string line;
+    while (getline(fin, line)) {
+        if (trim(line).empty()) continue;
+        auto t = split_csv(line);
+        if ((int)t.size() <= max({idx_fecha, idx_price, idx_qty, idx_side}))
+            t.resize(max({idx_fecha, idx_price, idx_qty, idx_side})+1);
+
+        long long f; double p, q;
+        bool okf = to_int64(t[idx_fecha], f);
+        bool okp = to_double(t[idx_price], p);
+        bool okq = to_double(t[idx_qty], q);
+        string s = trim(t[idx_side]);
+
+        // Simula dropna de Python en (price, quantity, side)
+        if (!okf || !okp || !okq || !isfinite(p) || !isfinite(q) || s.empty())
+            continue;
+
+        out_rows.push_back({f, p, q, s});
+    }
+    TRACE_COUNTER("rows_parsed", out_rows.size() - n0);
+    return true;
+}
+
+/* ---------------- Core: build_df_for_side ---------------- */
+static inline vector<GroupRow> build_df_for_side(const vector<RawRow>& rows, const string& curr_side) {
+    // filtra por side
+    vector<RawRow> v;
+    v.reserve(rows.size());
+    for (const auto& r : rows) if (r.side == curr_side) v.push_back(r);
+    if (v.empty()) return {};
+
+    // orden estable por fecha_nano
+    stable_sort(v.begin(), v.end(), [](const RawRow& a, const RawRow& b){
+        return a.fecha_nano < b.fecha_nano;
+    });
+
+    // agrupa por fecha_nano
+    vector<GroupRow> out;
+    size_t i=0, n=v.size();
+    while (i<n) {
+        long long key = v[i].fecha_nano;
+        size_t j=i;
+        vector<double> ps, qs;
+        while (j<n && v[j].fecha_nano==key) {
+            double p=v[j].price, q=v[j].quantity;
+            if (isfinite(p) && isfinite(q) && p>0.0 && q>0.0) {
+                ps.push_back(p);
+                qs.push_back(q);
+            }
+            ++j;
+        }
+        out.push_back({key, curr_side, move(ps), move(qs)});
+        i=j;
+    }
+    return out;
+}
+
+/* ---------------- VWAP & spread ---------------- */
+static inline MetricRow make_metric(const string& instrument, const GroupRow& g) {
+    double vwap = NaN, spread = NaN, qty = 0.0;
+    const auto& P = g.prices;
+    const auto& W = g.quantities;
+
+    if (!P.empty() && P.size()==W.size()) {
+        double sumw = 0.0, sumpw = 0.0;
+        for (size_t i=0;i<P.size();++i) {
+            double w=W[i], p=P[i];
+            if (isfinite(w) && isfinite(p) && w>0.0) { sumw += w; sumpw += w*p; }
+        }
+        qty = sumw;
+        if (sumw > 0.0) {
+            vwap = sumpw / sumw;
+            double varw = 0.0;
+            for (size_t i=0;i<P.size();++i) {
+                double w=W[i], p=P[i];
+                if (isfinite(w) && isfinite(p) && w>0.0) {
+                    double d = p - vwap;
+                    varw += w * d * d;
+                }
+            }
+            varw /= sumw;
+            spread = std::sqrt(varw);
+        }
+    }
+    double ts_sec = static_cast<double>(g.fecha_nano) / 1e9;
+    return {instrument, g.side, g.fecha_nano, ts_sec, vwap, spread, qty};
+}
+
+/* ---------------- Etapas (usadas por process_market y pipeline) ---------------- */
+// Un .tka sirve en lugar de su .csv si esta al dia: v2 guarda tamaño/mtime del CSV de origen y
+// deben coincidir; si no los tiene (v1 o convertido sin origen) alcanza con que sea mas nuevo.
+static inline bool tka_is_current(const string& tka, const string& csv, string& why) {
+    TkaHeader h;
+    if (!read_tka_header(tka, h, why)) return false;
+    const TkaSource cur = tka_source_of(csv);
+    if (h.src.known()) {
+        if (h.src == cur) return true;
+        why = "el CSV cambio desde la conversion";
+        return false;
+    }
+    std::error_code ec1, ec2;
+    auto t_tka = std::filesystem::last_write_time(tka, ec1), t_csv = std::filesystem::last_write_time(csv, ec2);
+    if (!ec1 && !ec2 && t_tka >= t_csv) return true;
+    why = "el CSV es mas nuevo";
+    return false;
+}
+
+// Lista los .csv y .tka (tick_archive.hpp) de dir; si un instrumento tiene ambos se usa el .tka
+// cuando esta al dia (tka_is_current), si no el .csv con un aviso.
+// Devuelve false (con mensaje en err) si no se puede leer o no hay archivos.
+static inline bool list_market_files(const string& dir, vector<string>& csv_files, string& err) {
+    TRACE_SCOPE("list");
+    namespace fs = std::filesystem;
+    // Orden: el del directorio, tomando la posicion del .csv si existe (la del .tka si no). Asi el
+    // orden de instrumentos, y con el el de df_all, es el mismo que sin los .tka.
+    struct Pair { string csv, tka; size_t order = SIZE_MAX; };
+    vector<Pair> found;
+    unordered_map<string, size_t> pos;   // stem -> indice en found
+    try {
+        size_t n_seen = 0;
+        for (const auto& e : fs::directory_iterator(dir)) {
+            if (e.is_regular_file()) {
+                auto p = e.path();
+                auto ext = p.extension();
+                if (ext!=".csv" && ext!=".tka") continue;
+                auto it = pos.emplace(p.stem().string(), found.size()).first;
+                if (it->second==found.size()) found.emplace_back();
+                Pair& f = found[it->second];
+                (ext==".tka"? f.tka : f.csv) = p.string();
+                if (ext==".csv" || f.csv.empty()) f.order = n_seen;
+                ++n_seen;
+            }
+        }
+    } catch (const std::exception& ex) {
+        err = string("Error leyendo el directorio: ") + ex.what();
+        return false;
+    }
+    sort(found.begin(), found.end(), [](const Pair& a, const Pair& b){ return a.order < b.order; });
+    for (const auto& f : found) {
+        string why;
+        if (f.csv.empty()) csv_files.push_back(f.tka);
+        else if (f.tka.empty()) csv_files.push_back(f.csv);
+        else if (tka_is_current(f.tka, f.csv, why)) csv_files.push_back(f.tka);
+        else {
+            log_err("[WARN] " + f.tka + " desactualizado (" + why + "), se usa " + f.csv);
+            csv_files.push_back(f.csv);
+        }
+    }
+    if (csv_files.empty()) { err = "No hay CSVs en " + dir; return false; }
+    return true;
+}
+
+// dfs: instrumento (nombre de archivo sin extension) -> filas
+static inline void load_market_files(const vector<string>& files,
+                                     unordered_map<string, vector<RawRow>>& dfs) {
+    TRACE_SCOPE("read");
+    for (const auto& path : files) {
+        string stem = std::filesystem::path(path).stem().string();
+        vector<RawRow> rows;
+        bool ok = std::filesystem::path(path).extension()==".tka"? read_tka(path, rows)
+                                                                  : read_csv_minimal(path, rows);
+        if (!ok) {
+            log_err("Saltando (no legible): " + path);
+            continue;
+        }
+        if (!rows.empty()) dfs.emplace(stem, move(rows));
+    }
+}
+
+// Agrupa por (fecha_nano, side) y calcula VWAP/spread de todos los instrumentos.
+// eligible: instrumentos con vwap valido en BI, OF y TRADE (ordenados).
+static inline void build_metrics_all(const unordered_map<string, vector<RawRow>>& dfs,
+                                     vector<MetricRow>& df_all, vector<string>& eligible) {
+    TRACE_SCOPE("group_metrics");
+    df_all.reserve(df_all.size() + (1<<20));
+    for (const auto& kv : dfs) {
+        const string& inst = kv.first;
+        const auto& rows = kv.second;
+
+        // sides presentes
+        unordered_set<string> sides_present;
+        for (const auto& r : rows) sides_present.insert(r.side);
+
+        // build_df_for_side -> group rows por timestamp
+        vector<GroupRow> all_groups;
+        {
+            TRACE_SCOPE("group");
+            for (const string& s : sides_present) {
+                auto g = build_df_for_side(rows, s);
+                all_groups.insert(all_groups.end(), make_move_iterator(g.begin()), make_move_iterator(g.end()));
+            }
+            if (all_groups.empty()) continue;
+
+            // ordenamos por fecha para coherencia
+            sort(all_groups.begin(), all_groups.end(),
+                 [](const GroupRow& a, const GroupRow& b){
+                     if (a.fecha_nano!=b.fecha_nano) return a.fecha_nano<b.fecha_nano;
+                     return a.side < b.side;
+                 });
+        }
+        TRACE_COUNTER("groups_built", all_groups.size());
+
+        // sides con al menos un vwap valido
+        TRACE_SCOPE("metric");
+        unordered_set<string> sides_ok;
+        for (const auto& g : all_groups) {
+            MetricRow mr = make_metric(inst, g);
+            if (isfinite(mr.vwap)) sides_ok.insert(g.side);
+            df_all.push_back(move(mr));
+        }
+        if (sides_ok.count("BI") && sides_ok.count("OF") && sides_ok.count("TRADE"))
+            eligible.push_back(inst);
+    }
+    sort(eligible.begin(), eligible.end());
+}
+
+/* ---------------- Book as-of (process_market --book) ---------------- */
+// En cada fila: ultimo BI y OF con vwap valido y fecha_nano <= la de la fila (mismo timestamp incluido).
+struct BookFeat {
+    double bid = NaN, ask = NaN, mid = NaN, microprice = NaN, quote_spread = NaN, imbalance = NaN;
+};
+
+// Merge por instrumento con cursores que solo avanzan sobre BI y OF, una pasada por cada side
+// (BI, OF y TRADE), asi get_nowcast puede tomar el ultimo quote y no solo el del ultimo trade.
+// Requiere df_all agrupado por instrumento y cada side ordenado por fecha_nano (como lo dejan
+// build_metrics_all y el modo particionado). Devuelve un vector alineado con df_all.
+static inline vector<BookFeat> build_book_features(const vector<MetricRow>& df_all) {
+    TRACE_SCOPE("book");
+    vector<BookFeat> out(df_all.size());
+    vector<size_t> bi, of, tr;
+    auto merge = [&](const vector<size_t>& rows) {
+        size_t cb = 0, co = 0;
+        const MetricRow* b = nullptr;
+        const MetricRow* a = nullptr;
+        for (size_t t : rows) {
+            const long long ft = df_all[t].fecha_nano;
+            for (; cb<bi.size() && df_all[bi[cb]].fecha_nano<=ft; ++cb) if (isfinite(df_all[bi[cb]].vwap)) b = &df_all[bi[cb]];
+            for (; co<of.size() && df_all[of[co]].fecha_nano<=ft; ++co) if (isfinite(df_all[of[co]].vwap)) a = &df_all[of[co]];
+            BookFeat& f = out[t];
+            if (b) f.bid = b->vwap;
+            if (a) f.ask = a->vwap;
+            if (!b || !a) continue;
+            f.mid = 0.5 * (f.bid + f.ask);
+            f.quote_spread = f.ask - f.bid;
+            // microprice: pondera cada lado con el tamaño del opuesto; imbalance en [-1, 1]
+            const double qsum = b->qty + a->qty;
+            f.microprice = (f.bid * a->qty + f.ask * b->qty) / qsum;
+            f.imbalance = (b->qty - a->qty) / qsum;
+        }
+    };
+    size_t i = 0;
+    while (i < df_all.size()) {
+        const string& inst = df_all[i].instrument;
+        bi.clear(); of.clear(); tr.clear();
+        for (; i<df_all.size() && df_all[i].instrument==inst; ++i) {
+            const string& s = df_all[i].side;
+            if (s=="BI") bi.push_back(i);
+            else if (s=="OF") of.push_back(i);
+            else if (s=="TRADE") tr.push_back(i);
+        }
+        merge(bi); merge(of); merge(tr);
+    }
+    return out;
+}
+
+static inline void write_df_header(ostream& fout, bool book) {
+    fout << "instrument,side,fecha_nano,ts_sec,vwap,spread";
+    if (book) fout << ",bid,ask,mid,microprice,quote_spread,imbalance";
+    fout << "\n";
+}
+
+// una fila de df_all (+ columnas de book si bf != nullptr); el stream ya tiene fixed + setprecision(10)
+static inline void write_df_row(ostream& fout, const MetricRow& r, const BookFeat* bf = nullptr) {
+    fout << r.instrument << "," << r.side << ","
+         << r.fecha_nano << "," << r.ts_sec << ",";
+    if (isfinite(r.vwap)) fout << r.vwap; else fout << "";
+    fout << ",";
+    if (isfinite(r.spread)) fout << r.spread; else fout << "";
+    if (bf) {
+        for (double v : {bf->bid, bf->ask, bf->mid, bf->microprice, bf->quote_spread, bf->imbalance}) {
+            fout << ",";
+            if (isfinite(v)) fout << v;
+        }
+    }
+    fout << "\n";
+}
+
+static inline bool write_df_all(const string& path, const vector<MetricRow>& df_all,
+                                const vector<BookFeat>* book = nullptr) {
+    TRACE_SCOPE("write");
+    ofstream fout(path);
+    if (!fout) return false;
+    write_df_header(fout, book != nullptr);
+    fout.setf(std::ios::fixed); fout<<setprecision(10);
+    for (size_t i=0;i<df_all.size();++i) write_df_row(fout, df_all[i], book? &(*book)[i] : nullptr);
+    return (bool)fout;
+}
@@ -0,0 +1,366 @@
+// mlp_core.hpp — estructuras del bundle, loader/saver txt, forward y metricas.
+// Compartido por mlp_infer_plain y mlp_train.
+#pragma once
+#include "csv_util.hpp"
+#include "trace.hpp"
+
+struct Layer {
+    int in_f=0, out_f=0;
+    vector<double> W; // row-major: size = in_f*out_f
+    vector<double> b; // size = out_f
+};
+struct Bundle {
+    string activation;              // "relu"|"tanh"|"logistic"
+    int n_features=0;
+    vector<double> scaler_mean;     // n_features
+    vector<double> scaler_scale;    // n_features
+    vector<Layer> layers;
+};
+
+/* ------------------ util csv ------------------ */
+static inline vector<string> split(const string& s, char delim){
+    vector<string> out; out.reserve(16);
+    string cur; cur.reserve(s.size());
+    for(char c: s){
+        if(c==delim){ out.push_back(cur); cur.clear(); }
+        else cur.push_back(c);
+    }
+    out.push_back(cur);
+    return out;
+}
+static inline vector<double> parse_floats_csv_line(const string& line){
+    vector<string> t = split(trim(line), ',');
+    vector<double> v; v.reserve(t.size());
+    for(auto& s : t){
+        s = trim(s);
+        if(s.empty()){ v.push_back(0.0); continue; }
+        v.push_back(strtod(s.c_str(), nullptr));
+    }
+    return v;
+}
+
+/* -------------- activaciones ----------------- */
+static inline void relu_inplace(vector<double>& v){
+    for(double& x: v) if(x<0.0) x=0.0;
+}
+static inline void logistic_inplace(vector<double>& v){
+    for(double& x: v) x = 1.0 / (1.0 + exp(-x));
+}
+
+/* -------------- activaciones rápidas (SIMD) -- */
+// Vectores con extensiones de GCC: 4 doubles si se compila con AVX (-mavx2/-march=native),
+// 2 doubles (SSE2) si no. Sin dependencias de libm.
+//
+// exp:  reduccion x = k*ln2 + r, |r| <= ln2/2, Taylor grado 12 en r y 2^k armado en el exponente.
+//       Error relativo max ~2 ulp (< 1e-15) en [-708, 709]; fuera de ese rango satura
+//       (exp(-inf..-708) ~ 3e-308, exp(709..inf) ~ 8e307), irrelevante para tanh/logistic.
+// tanh: (1-e)/(1+e) con e = exp(-2|x|) y signo restaurado. Error absoluto max < 1e-15.
+// logistic: 1/(1+exp(-x)). Error absoluto max < 1e-15.
+// --check_act barre el rango contra libm y falla si se supera alguna de estas cotas.
+enum class ActImpl { Libm, Fast };
+
+#ifdef __AVX__
+static constexpr int VLEN = 4;
+#else
+static constexpr int VLEN = 2;
+#endif
+typedef double    vd __attribute__((vector_size(8*VLEN)));
+typedef long long vi __attribute__((vector_size(8*VLEN)));
+
+static inline vd vd_set1(double x){ return vd{} + x; }
+
+static inline vd exp_vd(vd x){
+    x = x > vd_set1(709.0)  ? vd_set1(709.0)  : x;
+    x = x < vd_set1(-708.0) ? vd_set1(-708.0) : x;
+    // t = x*log2(e) + 1.5*2^52 deja round(x*log2(e)) en los bits bajos de la mantisa
+    const vd shift = vd_set1(6755399441055744.0);
+    vd t  = x * 1.4426950408889634 + shift;
+    vd kd = t - shift;
+    vi k  = (vi)t - (vi)shift;
+    vd r  = x - kd * 6.93147180369123816490e-01 - kd * 1.90821492927058770002e-10;
+    vd p = vd_set1(1.0/479001600.0);
+    p = p*r + 1.0/39916800.0;
+    p = p*r + 1.0/3628800.0;
+    p = p*r + 1.0/362880.0;
+    p = p*r + 1.0/40320.0;
+    p = p*r + 1.0/5040.0;
+    p = p*r + 1.0/720.0;
+    p = p*r + 1.0/120.0;
+    p = p*r + 1.0/24.0;
+    p = p*r + 1.0/6.0;
+    p = p*r + 0.5;
+    p = p*r + 1.0;
+    p = p*r + 1.0;
+    vi e = (k + 1023) << 52;
+    return p * (vd)e;
+}
+static inline vd tanh_vd(vd x){
+    const vi sign = (vi)vd_set1(-0.0);
+    vi s  = (vi)x & sign;
+    vd ax = (vd)((vi)x & ~sign);
+    vd e  = exp_vd(-2.0 * ax);
+    vd t  = (1.0 - e) / (1.0 + e);
+    return (vd)((vi)t | s);
+}
+static inline vd logistic_vd(vd x){
+    return 1.0 / (1.0 + exp_vd(-x));
+}
+
+// Aplica f en bloques de VLEN; la cola se completa en un buffer temporal.
+template<class F>
+static inline void apply_vd(double* x, size_t n, F f){
+    size_t i=0;
+    for(; i+VLEN<=n; i+=VLEN){
+        vd v; memcpy(&v, x+i, sizeof v);
+        v = f(v);
+        memcpy(x+i, &v, sizeof v);
+    }
+    if(i<n){
+        double tmp[VLEN] = {};
+        memcpy(tmp, x+i, sizeof(double)*(n-i));
+        vd v; memcpy(&v, tmp, sizeof v);
+        v = f(v);
+        memcpy(tmp, &v, sizeof v);
+        memcpy(x+i, tmp, sizeof(double)*(n-i));
+    }
+}
+static inline void exp_fast_inplace(double* x, size_t n){ apply_vd(x, n, [](vd v){ return exp_vd(v); }); }
+static inline void tanh_fast_inplace(double* x, size_t n){ apply_vd(x, n, [](vd v){ return tanh_vd(v); }); }
+static inline void logistic_fast_inplace(double* x, size_t n){ apply_vd(x, n, [](vd v){ return logistic_vd(v); }); }
+
+static inline void activation_inplace(const string& act, vector<double>& Z, ActImpl impl){
+    if(act=="relu") relu_inplace(Z);
+    else if(act=="tanh"){
+        if(impl==ActImpl::Fast) tanh_fast_inplace(Z.data(), Z.size());
+        else for(double& v: Z) v = tanh(v);
+    }
+    else if(act=="logistic"){
+        if(impl==ActImpl::Fast) logistic_fast_inplace(Z.data(), Z.size());
+        else logistic_inplace(Z);
+    }
+    else throw runtime_error("Activacion no soportada: "+act);
+}
+
+/* -------------- linalg básica ---------------- */
+static inline vector<double> matmul(const vector<double>& A, int n, int in,
+                             const vector<double>& W, int out){
+    vector<double> Z((size_t)n*out, 0.0);
+    for(int r=0; r<n; ++r){
+        const double* arow = &A[(size_t)r*in];
+        for(int c=0; c<out; ++c){
+            double acc=0.0;
+            for(int k=0; k<in; ++k){
+                acc += arow[k] * W[(size_t)k*out + c];
+            }
+            Z[(size_t)r*out + c] = acc;
+        }
+    }
+    return Z;
+}
+static inline void add_bias_inplace(vector<double>& Z, int n, int out, const vector<double>& b){
+    for(int r=0;r<n;++r){
+        double* row = &Z[(size_t)r*out];
+        for(int c=0;c<out;++c) row[c] += b[c];
+    }
+}
+
+/* -------------- loader del bundle txt -------- */
+static inline Bundle load_bundle_txt(const string& path){
+    TRACE_SCOPE("load_bundle");
+    ifstream fin(path);
+    if(!fin) throw runtime_error("No se pudo abrir: " + path);
+
+    Bundle B;
+    string line;
+
+    auto expect_prefix=[&](const string& pref){
+        if(!getline(fin, line)) throw runtime_error("Formato invalido (EOF): se esperaba "+pref);
+        line = trim(line);
+        if(line.rfind(pref,0)!=0) throw runtime_error("Se esperaba prefijo "+pref+", got: "+line);
+        return line.substr(pref.size());
+    };
+
+    // Cabecera
+    B.activation = trim(expect_prefix("ACTIVATION:"));
+    B.n_features = stoi(trim(expect_prefix("N_FEATURES:")));
+
+    {
+        string rest = trim(expect_prefix("SCALER_MEAN:"));
+        B.scaler_mean = parse_floats_csv_line(rest);
+        if((int)B.scaler_mean.size()!=B.n_features) throw runtime_error("SCALER_MEAN size != N_FEATURES");
+    }
+    {
+        string rest = trim(expect_prefix("SCALER_SCALE:"));
+        B.scaler_scale = parse_floats_csv_line(rest);
+        if((int)B.scaler_scale.size()!=B.n_features) throw runtime_error("SCALER_SCALE size != N_FEATURES");
+    }
+    int L = stoi(trim(expect_prefix("LAYERS:")));
+    if(L<=0) throw runtime_error("LAYERS debe ser > 0");
+
+    for(int li=0; li<L; ++li){
+        string io = trim(expect_prefix("IN_OUT:"));
+        auto io_parts = split(io, ',');
+        if(io_parts.size()!=2) throw runtime_error("IN_OUT malformado");
+        Layer Lr;
+        Lr.in_f  = stoi(trim(io_parts[0]));
+        Lr.out_f = stoi(trim(io_parts[1]));
+        if(Lr.in_f<=0 || Lr.out_f<=0) throw runtime_error("IN_OUT dims invalidas");
+        Lr.W.assign((size_t)Lr.in_f * Lr.out_f, 0.0);
+
+        for(int i=0;i<Lr.in_f;++i){
+            string wr = trim(expect_prefix("W_ROW:"));
+            auto row = parse_floats_csv_line(wr);
+            if((int)row.size()!=Lr.out_f) throw runtime_error("W_ROW size != out_f");
+            for(int j=0;j<Lr.out_f;++j) Lr.W[(size_t)i*Lr.out_f + j] = row[j];
+        }
+        string bline = trim(expect_prefix("B:"));
+        Lr.b = parse_floats_csv_line(bline);
+        if((int)Lr.b.size()!=Lr.out_f) throw runtime_error("B size != out_f");
+
+        B.layers.push_back(move(Lr));
+    }
+    if(B.layers.front().in_f != B.n_features)
+        throw runtime_error("n_features del scaler != in_f de la primera capa");
+    return B;
+}
+
+// Escribe el mismo formato que lee load_bundle_txt (17 digitos: ida y vuelta exacta).
+static inline void save_bundle_txt(const Bundle& B, const string& path){
+    ofstream fout(path);
+    if(!fout) throw runtime_error("No se pudo abrir para escritura: " + path);
+    fout<<setprecision(17);
+    auto row=[&](const char* pref, const double* v, int n){
+        fout<<pref;
+        for(int i=0;i<n;++i){ if(i) fout<<","; fout<<v[i]; }
+        fout<<"\n";
+    };
+    fout<<"ACTIVATION:"<<B.activation<<"\n";
+    fout<<"N_FEATURES:"<<B.n_features<<"\n";
+    row("SCALER_MEAN:", B.scaler_mean.data(), B.n_features);
+    row("SCALER_SCALE:", B.scaler_scale.data(), B.n_features);
+    fout<<"LAYERS:"<<B.layers.size()<<"\n";
+    for(const auto& L: B.layers){
+        fout<<"IN_OUT:"<<L.in_f<<","<<L.out_f<<"\n";
+        for(int i=0;i<L.in_f;++i) row("W_ROW:", &L.W[(size_t)i*L.out_f], L.out_f);
+        row("B:", L.b.data(), L.out_f);
+    }
+    if(!fout) throw runtime_error("Error escribiendo: " + path);
+}
+
+/* -------------- forward ---------------------- */
+// Tiempos por capa (matmul+bias+activacion) y la parte de activacion, acumulados en ms.
+struct LayerProf {
+    vector<double> total_ms, act_ms;
+};
+
+// X_raw: n x n_features (sin escalar)
+static inline vector<double> mlp_predict(const Bundle& B, const vector<double>& X_raw, int n,
+                                  ActImpl impl=ActImpl::Libm, LayerProf* prof=nullptr){
+    TRACE_SCOPE("forward");
+    const int nf = B.n_features;
+    if((int)X_raw.size()!=n*nf) throw runtime_error("X_raw size invalido");
+
+    // StandardScaler
+    vector<double> A((size_t)n*nf);
+    for(int r=0;r<n;++r){
+        for(int c=0;c<nf;++c){
+            double x = X_raw[(size_t)r*nf + c];
+            A[(size_t)r*nf + c] = (x - B.scaler_mean[c]) / B.scaler_scale[c];
+        }
+    }
+
+    // Capas
+    if(prof){
+        prof->total_ms.resize(B.layers.size(), 0.0);
+        prof->act_ms.resize(B.layers.size(), 0.0);
+    }
+    for(size_t li=0; li<B.layers.size(); ++li){
+        const Layer& L = B.layers[li];
+        chrono::steady_clock::time_point t0, t1;
+        if(prof) t0 = chrono::steady_clock::now();
+        vector<double> Z = matmul(A, n, L.in_f, L.W, L.out_f);
+        add_bias_inplace(Z, n, L.out_f, L.b);
+        if(prof) t1 = chrono::steady_clock::now();
+        const bool last = (li+1==B.layers.size());
+        if(!last) activation_inplace(B.activation, Z, impl);
+        if(prof){
+            auto t2 = chrono::steady_clock::now();
+            prof->total_ms[li] += chrono::duration<double, milli>(t2 - t0).count();
+            prof->act_ms[li]   += chrono::duration<double, milli>(t2 - t1).count();
+        }
+        A.swap(Z);
+    }
+
+    // salida lineal; esperamos out_f=1
+    int out_f = B.layers.back().out_f;
+    vector<double> yhat(n);
+    for(int r=0;r<n;++r) yhat[r] = A[(size_t)r*out_f + 0];
+    return yhat;
+}
+
+/* -------------- leer xy_train.csv (opcional) - header: p__...,m__...,y */
+static inline void read_xy_csv(const string& path, vector<double>& X, vector<double>& y, int& n, int& d){
+    TRACE_SCOPE("parse");
+    ifstream fin(path);
+    if(!fin) throw runtime_error("No se pudo abrir: "+path);
+    string header; if(!getline(fin, header)) throw runtime_error("CSV vacio");
+    auto cols = split(trim(header), ',');
+    int y_idx = (int)cols.size()-1;
+    if(cols[y_idx]!="y") throw runtime_error("La ultima columna debe llamarse 'y'");
+
+    vector<vector<double>> Xrows;
+    vector<double> Y;
+    string line;
+    while(getline(fin, line)){
+        line = trim(line); if(line.empty()) continue;
+        auto vals = parse_floats_csv_line(line);
+        if((int)vals.size()!= (int)cols.size()) throw runtime_error("Fila con distinto numero de columnas");
+        Y.push_back(vals[y_idx]);
+        vals.pop_back();
+        Xrows.push_back(move(vals));
+    }
+    n = (int)Xrows.size();
+    d = n? (int)Xrows[0].size() : 0;
+    X.assign((size_t)n*d, 0.0);
+    for(int i=0;i<n;++i){
+        if((int)Xrows[i].size()!=d) throw runtime_error("Fila con ancho inconsistente");
+        memcpy(&X[(size_t)i*d], Xrows[i].data(), sizeof(double)*d);
+    }
+    y.swap(Y);
+    TRACE_COUNTER("rows_parsed", n);
+}
+
+/* -------------- métricas opcionales ---------- */
+static inline pair<double,double> mse_r2(const vector<double>& y, const vector<double>& yhat){
+    if(y.size()!=yhat.size()) throw runtime_error("mse_r2: tamaño distinto");
+    int n = (int)y.size();
+    double mse=0.0, mu=0.0;
+    for(double v: y) mu+=v; mu/=n;
+    double sst=0.0;
+    for(int i=0;i<n;++i){
+        double e = y[i]-yhat[i];
+        mse += e*e;
+        double d = y[i]-mu;
+        sst += d*d;
+    }
+    mse/=n;
+    double r2 = (sst>0)? 1.0 - n*mse/sst : 0.0;
+    return {mse, r2};
+}
+
+/* -------------- métricas incrementales ------- */
+// Mismo resultado que mse_r2 pero sin guardar y/yhat: SSE + Welford para SST.
+struct RunningMetrics {
+    long long n=0;
+    double sse=0.0, mean=0.0, m2=0.0;
+    void add(double y, double yhat){
+        double e = y - yhat;
+        sse += e*e;
+        ++n;
+        double d = y - mean;
+        mean += d / n;
+        m2 += d * (y - mean);
+    }
+    double mse() const { return n? sse/n : 0.0; }
+    double r2()  const { return (m2>0)? 1.0 - sse/m2 : 0.0; }
+};
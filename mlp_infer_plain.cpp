@@ -1,237 +1,531 @@
-#include <bits/stdc++.h>
-using namespace std;
+#include "mlp_core.hpp"
+#include "drift_monitor.hpp"
 
-struct Layer {
-    int in_f=0, out_f=0;
-    vector<double> W; // row-major: size = in_f*out_f
-    vector<double> b; // size = out_f
+/* -------------- modo streaming --------------- */
+// Cola bloqueante simple (mutex + condvar). close() despierta a todos y pop devuelve false al vaciarse.
+template<class T>
+class BlockingQueue {
+public:
+    void push(T v){
+        { lock_guard<mutex> lk(mu_); q_.push_back(move(v)); }
+        cv_.notify_one();
+    }
+    bool pop(T& out){
+        unique_lock<mutex> lk(mu_);
+        cv_.wait(lk, [&]{ return !q_.empty() || closed_; });
+        if(q_.empty()) return false;
+        out = move(q_.front()); q_.pop_front();
+        return true;
+    }
+    void close(){
+        { lock_guard<mutex> lk(mu_); closed_ = true; }
+        cv_.notify_all();
+    }
+private:
+    mutex mu_;
+    condition_variable cv_;
+    deque<T> q_;
+    bool closed_=false;
 };
-struct Bundle {
-    string activation;              // "relu"|"tanh"|"logistic"
-    int n_features=0;
-    vector<double> scaler_mean;     // n_features
-    vector<double> scaler_scale;    // n_features
-    vector<Layer> layers;
+
+struct Chunk {
+    size_t seq=0;
+    int n=0;
+    vector<double> X;     // chunk_rows x d
+    vector<double> y;     // solo con --eval
+    vector<double> yhat;
 };
 
-/* ------------------ util csv ------------------ */
-static inline string trim(const string& s){
-    size_t a=s.find_first_not_of(" \t\r\n"); if(a==string::npos) return "";
-    size_t b=s.find_last_not_of(" \t\r\n"); return s.substr(a,b-a+1);
-}
-static vector<string> split(const string& s, char delim){
-    vector<string> out; out.reserve(16);
-    string cur; cur.reserve(s.size());
-    for(char c: s){
-        if(c==delim){ out.push_back(cur); cur.clear(); }
-        else cur.push_back(c);
+// Parsea una fila CSV de doubles directo a out (sin strings intermedios).
+// Campos vacios -> 0.0, igual que parse_floats_csv_line. Devuelve #columnas leidas.
+static int parse_row_into(const string& line, double* out, int max_cols){
+    const char* p = line.c_str();
+    int k = 0;
+    while(true){
+        while(*p==' ' || *p=='\t') ++p;
+        char* end = nullptr;
+        double v = strtod(p, &end);
+        if(end==p) v = 0.0;
+        if(k<max_cols) out[k] = v;
+        ++k;
+        p = end;
+        while(*p && *p!=',') ++p;
+        if(*p!=',') break;
+        ++p;
     }
-    out.push_back(cur);
-    return out;
+    return k;
 }
-static vector<double> parse_floats_csv_line(const string& line){
-    vector<string> t = split(trim(line), ',');
-    vector<double> v; v.reserve(t.size());
-    for(auto& s : t){
-        s = trim(s);
-        if(s.empty()){ v.push_back(0.0); continue; }
-        v.push_back(strtod(s.c_str(), nullptr));
+
+struct StreamOpts {
+    int threads = max(1u, thread::hardware_concurrency());
+    int chunk_rows = 4096;
+    int n_print = 5;
+    ActImpl act = ActImpl::Libm;
+    DriftOpts drift;
+    ostream* drift_out = &cerr;
+};
+
+// Pipeline: 1 hilo parser -> N workers (mlp_predict por chunk) -> writer ordenado (hilo llamador).
+// La memoria queda acotada por un pool fijo de 2*threads chunks que se reciclan.
+// Si una fila no parsea el writer deja de emitir en cuanto se entera, pero los chunks anteriores
+// ya pueden estar escritos: con exit status 1 la salida es parcial y no debe usarse.
+static int stream_predict(const Bundle& B, const string& path, bool eval, const StreamOpts& opt){
+    ifstream fin(path);
+    if(!fin){ cerr<<"No se pudo abrir "<<path<<"\n"; return 1; }
+    string header; if(!getline(fin, header)){ cerr<<"CSV vacio\n"; return 1; }
+    auto cols = split(trim(header), ',');
+    const int ncols = (int)cols.size();
+    const int d = eval? ncols-1 : ncols;
+    if(eval && trim(cols.back())!="y"){ cerr<<"La ultima columna debe llamarse 'y'\n"; return 1; }
+    if(d != B.n_features){
+        cerr<<"[ERROR] columnas de X="<<d<<" != n_features del modelo "<<B.n_features<<"\n";
+        return 1;
     }
-    return v;
-}
 
-/* -------------- activaciones ----------------- */
-static inline void relu_inplace(vector<double>& v){
-    for(double& x: v) if(x<0.0) x=0.0;
-}
-static inline void logistic_inplace(vector<double>& v){
-    for(double& x: v) x = 1.0 / (1.0 + exp(-x));
-}
+    const int n_workers = max(1, opt.threads);
+    const int R = max(1, opt.chunk_rows);
+    BlockingQueue<unique_ptr<Chunk>> free_q, work_q, done_q;
+    for(int i=0;i<2*n_workers;++i){
+        auto c = make_unique<Chunk>();
+        c->X.resize((size_t)R*d);
+        if(eval) c->y.resize(R);
+        free_q.push(move(c));
+    }
 
-/* -------------- linalg básica ---------------- */
-static vector<double> matmul(const vector<double>& A, int n, int in,
-                             const vector<double>& W, int out){
-    vector<double> Z((size_t)n*out, 0.0);
-    for(int r=0; r<n; ++r){
-        const double* arow = &A[(size_t)r*in];
-        for(int c=0; c<out; ++c){
-            double acc=0.0;
-            for(int k=0; k<in; ++k){
-                acc += arow[k] * W[(size_t)k*out + c];
+    string parse_err;
+    atomic<bool> parse_failed{false};   // el writer lo mira sin tomar parse_err
+    auto t0 = chrono::steady_clock::now();
+
+    thread parser([&]{
+        vector<double> row(ncols);
+        string line;
+        size_t seq = 0;
+        bool eof = false;
+        while(!eof && !parse_failed){
+            unique_ptr<Chunk> c;
+            if(!free_q.pop(c)) break;
+            TRACE_SCOPE("parse_chunk");
+            c->seq = seq++; c->n = 0;
+            while(c->n < R){
+                if(!getline(fin, line)){ eof = true; break; }
+                if(trim(line).empty()) continue;
+                if(parse_row_into(line, row.data(), ncols)!=ncols){
+                    parse_err = "Fila con distinto numero de columnas";
+                    parse_failed = true;
+                    break;
+                }
+                memcpy(&c->X[(size_t)c->n*d], row.data(), sizeof(double)*d);
+                if(eval) c->y[c->n] = row[d];
+                ++c->n;
             }
-            Z[(size_t)r*out + c] = acc;
+            TRACE_COUNTER("rows_parsed", c->n);
+            if(c->n>0 && !parse_failed) work_q.push(move(c));
         }
+        work_q.close();
+    });
+
+    vector<thread> workers;
+    atomic<int> live_workers{n_workers};
+    for(int w=0; w<n_workers; ++w){
+        workers.emplace_back([&]{
+            unique_ptr<Chunk> c;
+            vector<double> Xn;
+            while(work_q.pop(c)){
+                TRACE_SCOPE("forward_chunk");
+                if(c->n == R) c->yhat = mlp_predict(B, c->X, c->n, opt.act);
+                else {
+                    Xn.assign(c->X.begin(), c->X.begin() + (size_t)c->n*d);
+                    c->yhat = mlp_predict(B, Xn, c->n, opt.act);
+                }
+                done_q.push(move(c));
+            }
+            if(--live_workers == 0) done_q.close();
+        });
     }
-    return Z;
-}
-static inline void add_bias_inplace(vector<double>& Z, int n, int out, const vector<double>& b){
-    for(int r=0;r<n;++r){
-        double* row = &Z[(size_t)r*out];
-        for(int c=0;c<out;++c) row[c] += b[c];
+
+    // writer: reordena por seq y emite
+    cout.setf(std::ios::fixed); cout<<setprecision(10);
+    RunningMetrics rm;
+    DriftMonitor dm(opt.drift, *opt.drift_out);
+    map<size_t, unique_ptr<Chunk>> pending;
+    size_t next_seq = 0;
+    long long row_idx = 0;
+    unique_ptr<Chunk> c;
+    while(done_q.pop(c)){
+        if(parse_failed){ free_q.push(move(c)); continue; }   // drena sin escribir
+        pending.emplace(c->seq, move(c));
+        for(auto it = pending.find(next_seq); it!=pending.end(); it = pending.find(next_seq)){
+            TRACE_SCOPE("write_chunk");
+            Chunk& ch = *it->second;
+            for(int i=0;i<ch.n;++i, ++row_idx){
+                if(eval){
+                    rm.add(ch.y[i], ch.yhat[i]);
+                    if(opt.drift.every) dm.add(ch.y[i], ch.yhat[i]);
+                    if(row_idx < opt.n_print)
+                        cout<<"i="<<row_idx<<"  y="<<ch.y[i]<<"  yhat="<<ch.yhat[i]<<"\n";
+                }else{
+                    cout<<ch.yhat[i]<<"\n";
+                }
+            }
+            free_q.push(move(it->second));
+            pending.erase(it);
+            ++next_seq;
+        }
     }
-}
+    free_q.close();
+    parser.join();
+    for(auto& t: workers) t.join();
+    auto t1 = chrono::steady_clock::now();
 
-/* -------------- loader del bundle txt -------- */
-static Bundle load_bundle_txt(const string& path){
-    ifstream fin(path);
-    if(!fin) throw runtime_error("No se pudo abrir: " + path);
+    if(!parse_err.empty()){ cerr<<parse_err<<"\n"; return 1; }
+    if(eval){
+        if(opt.drift.every && dm.count() % opt.drift.every) dm.report();
+        double elapsed_ms = chrono::duration<double, milli>(t1 - t0).count();
+        cout<<"\nMSE="<<rm.mse()<<"  R2="<<rm.r2()<<"\n";
+        cout<<"Filas: "<<row_idx<<"  threads="<<n_workers<<"  chunk="<<R<<"\n";
+        cout<<"Tiempo total (parse+inferencia, pipeline): "<<elapsed_ms<<" ms\n";
+        cout<<"Tiempo promedio por fila: "<<(row_idx>0? elapsed_ms*1000.0/row_idx : 0.0)<<" us\n";
+    }
+    return 0;
+}
 
-    Bundle B;
-    string line;
+/* -------------- ensamble multi-modelo -------- */
+// Varios bundles sobre el mismo X en una sola pasada: el CSV se lee en tiles de filas que quedan
+// en cache y cada tile pasa por todos los modelos antes de leer el siguiente (memoria acotada).
+// Los modelos con la misma forma (activacion + dims de capas) forman un grupo que corre capa por
+// capa sobre un buffer ancho: la capa 0 es un GEMM con las columnas de todos los modelos (el scaler
+// de cada modelo se pliega en sus W/b: W'=W/scale, b'=b-sum(mean/scale*W), asi todos leen el mismo
+// X crudo) y las siguientes son block-diagonales (cada modelo lee solo su porcion de columnas).
+// W se guarda transpuesta (una fila por neurona) para que el producto interno sea contiguo.
+struct PackedLayer {
+    int in_f=0, out_f=0;        // por modelo
+    bool shared_in=false;       // capa 0: todos los modelos leen las mismas in_f columnas
+    vector<double> Wt;          // (modelos*out_f) x in_f
+    vector<double> b;           // modelos*out_f
+};
 
-    auto expect_prefix=[&](const string& pref){
-        if(!getline(fin, line)) throw runtime_error("Formato invalido (EOF): se esperaba "+pref);
-        line = trim(line);
-        if(line.rfind(pref,0)!=0) throw runtime_error("Se esperaba prefijo "+pref+", got: "+line);
-        return line.substr(pref.size());
-    };
+struct ModelGroup {
+    string key;
+    vector<int> members;        // indices en la lista de bundles
+    vector<PackedLayer> layers;
+    double ms=0.0;              // forward del grupo completo: no se puede repartir por modelo
+};
 
-    // Cabecera
-    B.activation = trim(expect_prefix("ACTIVATION:"));
-    B.n_features = stoi(trim(expect_prefix("N_FEATURES:")));
+static string shape_key(const Bundle& B){
+    string k = B.activation;
+    for(const auto& L: B.layers) k += ":" + to_string(L.in_f) + "x" + to_string(L.out_f);
+    return k;
+}
 
-    {
-        string rest = trim(expect_prefix("SCALER_MEAN:"));
-        B.scaler_mean = parse_floats_csv_line(rest);
-        if((int)B.scaler_mean.size()!=B.n_features) throw runtime_error("SCALER_MEAN size != N_FEATURES");
-    }
-    {
-        string rest = trim(expect_prefix("SCALER_SCALE:"));
-        B.scaler_scale = parse_floats_csv_line(rest);
-        if((int)B.scaler_scale.size()!=B.n_features) throw runtime_error("SCALER_SCALE size != N_FEATURES");
-    }
-    int L = stoi(trim(expect_prefix("LAYERS:")));
-    if(L<=0) throw runtime_error("LAYERS debe ser > 0");
-
-    for(int li=0; li<L; ++li){
-        string io = trim(expect_prefix("IN_OUT:"));
-        auto io_parts = split(io, ',');
-        if(io_parts.size()!=2) throw runtime_error("IN_OUT malformado");
-        Layer Lr;
-        Lr.in_f  = stoi(trim(io_parts[0]));
-        Lr.out_f = stoi(trim(io_parts[1]));
-        if(Lr.in_f<=0 || Lr.out_f<=0) throw runtime_error("IN_OUT dims invalidas");
-        Lr.W.assign((size_t)Lr.in_f * Lr.out_f, 0.0);
-
-        for(int i=0;i<Lr.in_f;++i){
-            string wr = trim(expect_prefix("W_ROW:"));
-            auto row = parse_floats_csv_line(wr);
-            if((int)row.size()!=Lr.out_f) throw runtime_error("W_ROW size != out_f");
-            for(int j=0;j<Lr.out_f;++j) Lr.W[(size_t)i*Lr.out_f + j] = row[j];
+static void pack_group(ModelGroup& g, const vector<Bundle>& models){
+    const int M = (int)g.members.size();
+    const Bundle& B0 = models[g.members[0]];
+    for(size_t li=0; li<B0.layers.size(); ++li){
+        PackedLayer P;
+        P.in_f = B0.layers[li].in_f; P.out_f = B0.layers[li].out_f; P.shared_in = (li==0);
+        P.Wt.assign((size_t)M*P.out_f*P.in_f, 0.0);
+        P.b.assign((size_t)M*P.out_f, 0.0);
+        for(int j=0;j<M;++j){
+            const Bundle& B = models[g.members[j]];
+            const Layer& L = B.layers[li];
+            for(int c=0;c<P.out_f;++c){
+                const int o = j*P.out_f + c;
+                double bias = L.b[c];
+                for(int k=0;k<P.in_f;++k){
+                    double w = L.W[(size_t)k*P.out_f + c];
+                    if(li==0){ w /= B.scaler_scale[k]; bias -= B.scaler_mean[k] * w; }
+                    P.Wt[(size_t)o*P.in_f + k] = w;
+                }
+                P.b[o] = bias;
+            }
         }
-        string bline = trim(expect_prefix("B:"));
-        Lr.b = parse_floats_csv_line(bline);
-        if((int)Lr.b.size()!=Lr.out_f) throw runtime_error("B size != out_f");
+        g.layers.push_back(move(P));
+    }
+}
 
-        B.layers.push_back(move(Lr));
+// Z (nt x modelos*out_f) = A * W + b; A tiene lda columnas (capa 0: d; si no: modelos*in_f)
+static void forward_packed(const PackedLayer& L, int M, const vector<double>& A, int lda, int nt, vector<double>& Z){
+    const int wide = M*L.out_f;
+    Z.resize((size_t)nt*wide);
+    for(int r=0;r<nt;++r){
+        const double* arow0 = &A[(size_t)r*lda];
+        double* zrow = &Z[(size_t)r*wide];
+        for(int j=0;j<M;++j){
+            const double* arow = L.shared_in? arow0 : arow0 + (size_t)j*L.in_f;
+            for(int c=0;c<L.out_f;++c){
+                const int o = j*L.out_f + c;
+                const double* w = &L.Wt[(size_t)o*L.in_f];
+                double acc = 0.0;
+                for(int k=0;k<L.in_f;++k) acc += arow[k] * w[k];
+                zrow[o] = acc + L.b[o];
+            }
+        }
     }
-    if(B.layers.front().in_f != B.n_features)
-        throw runtime_error("n_features del scaler != in_f de la primera capa");
-    return B;
 }
 
-/* -------------- forward ---------------------- */
-// X_raw: n x n_features (sin escalar)
-static vector<double> mlp_predict(const Bundle& B, const vector<double>& X_raw, int n){
-    const int nf = B.n_features;
-    if((int)X_raw.size()!=n*nf) throw runtime_error("X_raw size invalido");
-
-    // StandardScaler
-    vector<double> A((size_t)n*nf);
-    for(int r=0;r<n;++r){
-        for(int c=0;c<nf;++c){
-            double x = X_raw[(size_t)r*nf + c];
-            A[(size_t)r*nf + c] = (x - B.scaler_mean[c]) / B.scaler_scale[c];
+// drift: monitor sobre la media del ensamble (StreamOpts::drift)
+static int ensemble_eval(const vector<Bundle>& models, const vector<string>& names,
+                         const string& xy_path, int n_print, ActImpl impl,
+                         const DriftOpts& drift, ostream& drift_out){
+    const int M = (int)models.size();
+    ifstream fin(xy_path);
+    if(!fin){ cerr<<"No se pudo abrir "<<xy_path<<"\n"; return 1; }
+    string header; if(!getline(fin, header)){ cerr<<"CSV vacio\n"; return 1; }
+    auto cols = split(trim(header), ',');
+    const int ncols = (int)cols.size(), d = ncols-1;
+    if(trim(cols.back())!="y"){ cerr<<"La ultima columna debe llamarse 'y'\n"; return 1; }
+    for(int m=0;m<M;++m){
+        if(models[m].n_features != d){
+            cerr<<"[ERROR] "<<names[m]<<": n_features="<<models[m].n_features<<" != d="<<d<<"\n";
+            return 1;
         }
     }
 
-    // Capas
-    for(size_t li=0; li<B.layers.size(); ++li){
-        const Layer& L = B.layers[li];
-        vector<double> Z = matmul(A, n, L.in_f, L.W, L.out_f);
-        add_bias_inplace(Z, n, L.out_f, L.b);
-        const bool last = (li+1==B.layers.size());
-        if(!last){
-            if(B.activation=="relu") relu_inplace(Z);
-            else if(B.activation=="tanh"){ for(double& v: Z) v = tanh(v); }
-            else if(B.activation=="logistic") logistic_inplace(Z);
-            else throw runtime_error("Activacion no soportada: "+B.activation);
+    // agrupar por forma y empaquetar las capas
+    vector<ModelGroup> groups;
+    {
+        map<string,int> by_key;
+        for(int m=0;m<M;++m){
+            const string key = shape_key(models[m]);
+            auto it = by_key.find(key);
+            if(it==by_key.end()){
+                it = by_key.emplace(key, (int)groups.size()).first;
+                ModelGroup g; g.key = key;
+                groups.push_back(move(g));
+            }
+            groups[it->second].members.push_back(m);
         }
-        A.swap(Z);
+        for(auto& g: groups) pack_group(g, models);
     }
 
-    // salida lineal; esperamos out_f=1
-    int out_f = B.layers.back().out_f;
-    vector<double> yhat(n);
-    for(int r=0;r<n;++r) yhat[r] = A[(size_t)r*out_f + 0];
-    return yhat;
-}
+    const int TILE = 256;
+    vector<double> Xt((size_t)TILE*d), yt(TILE), row(ncols), A, Z;
+    vector<RunningMetrics> rm(M);
+    RunningMetrics rm_ens;
+    DriftMonitor dm(drift, drift_out);
+    vector<double> ysum(TILE);
+    cout.setf(std::ios::fixed); cout<<setprecision(10);
+    double parse_ms = 0.0;
+    long long n = 0;
+    string line;
+    for(bool eof=false; !eof; ){
+        auto tp0 = chrono::steady_clock::now();
+        int nt = 0;
+        while(nt < TILE){
+            if(!getline(fin, line)){ eof = true; break; }
+            if(trim(line).empty()) continue;
+            if(parse_row_into(line, row.data(), ncols)!=ncols){ cerr<<"Fila con distinto numero de columnas\n"; return 1; }
+            memcpy(&Xt[(size_t)nt*d], row.data(), sizeof(double)*d);
+            yt[nt++] = row[d];
+        }
+        parse_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - tp0).count();
+        if(nt==0) break;
 
-/* -------------- leer xy_train.csv (opcional) - header: p__...,m__...,y */
-static void read_xy_csv(const string& path, vector<double>& X, vector<double>& y, int& n, int& d){
-    ifstream fin(path);
-    if(!fin) throw runtime_error("No se pudo abrir: "+path);
-    string header; if(!getline(fin, header)) throw runtime_error("CSV vacio");
-    auto cols = split(trim(header), ',');
-    int y_idx = (int)cols.size()-1;
-    if(cols[y_idx]!="y") throw runtime_error("La ultima columna debe llamarse 'y'");
+        fill(ysum.begin(), ysum.end(), 0.0);
+        for(auto& g: groups){
+            auto tg0 = chrono::steady_clock::now();
+            const int G = (int)g.members.size();
+            const string& act = models[g.members[0]].activation;
+            const vector<double>* in = &Xt;
+            int lda = d;
+            for(size_t li=0; li<g.layers.size(); ++li){
+                const PackedLayer& L = g.layers[li];
+                forward_packed(L, G, *in, lda, nt, Z);
+                if(li+1<g.layers.size()) activation_inplace(act, Z, impl);
+                A.swap(Z);
+                in = &A; lda = G*L.out_f;
+            }
+            g.ms += chrono::duration<double, milli>(chrono::steady_clock::now() - tg0).count();
+            const int out_f = g.layers.back().out_f;
+            for(int j=0;j<G;++j){
+                const int m = g.members[j];
+                for(int r=0;r<nt;++r){
+                    const double yh = A[(size_t)r*lda + j*out_f];
+                    rm[m].add(yt[r], yh);
+                    ysum[r] += yh;
+                }
+            }
+        }
+        for(int r=0;r<nt;++r, ++n){
+            const double ymean = ysum[r] / M;
+            rm_ens.add(yt[r], ymean);
+            if(drift.every) dm.add(yt[r], ymean);
+            if(n < n_print) cout<<"i="<<n<<"  y="<<yt[r]<<"  yhat_ens="<<ymean<<"\n";
+        }
+    }
 
-    vector<vector<double>> Xrows;
-    vector<double> Y;
-    string line;
-    while(getline(fin, line)){
-        line = trim(line); if(line.empty()) continue;
-        auto vals = parse_floats_csv_line(line);
-        if((int)vals.size()!= (int)cols.size()) throw runtime_error("Fila con distinto numero de columnas");
-        Y.push_back(vals[y_idx]);
-        vals.pop_back();
-        Xrows.push_back(move(vals));
+    if(drift.every && dm.count() % drift.every) dm.report();
+    cout<<"\nfilas="<<n<<"  modelos="<<M<<"  grupos por forma="<<groups.size()<<"\n";
+    cout<<"Parse X (una pasada, tiles de "<<TILE<<" filas): "<<parse_ms<<" ms\n";
+    double total_ms = 0.0;
+    for(size_t gi=0; gi<groups.size(); ++gi){
+        const auto& g = groups[gi];
+        cout<<"grupo "<<gi<<" ["<<g.key<<"] modelos="<<g.members.size()<<"  tiempo="<<g.ms<<" ms\n";
+        for(int m: g.members) cout<<"  "<<names[m]<<"  MSE="<<rm[m].mse()<<"  R2="<<rm[m].r2()<<"\n";
+        total_ms += g.ms;
     }
-    n = (int)Xrows.size();
-    d = n? (int)Xrows[0].size() : 0;
-    X.assign((size_t)n*d, 0.0);
-    for(int i=0;i<n;++i){
-        if((int)Xrows[i].size()!=d) throw runtime_error("Fila con ancho inconsistente");
-        memcpy(&X[(size_t)i*d], Xrows[i].data(), sizeof(double)*d);
+    cout<<"ENSAMBLE (media)  MSE="<<rm_ens.mse()<<"  R2="<<rm_ens.r2()<<"\n";
+    cout<<"Tiempo total de inferencia: "<<total_ms<<" ms (por grupo; los modelos de un grupo comparten cada capa)\n";
+    return 0;
+}
+
+/* -------------- chequeo / bench de activaciones */
+// Barre [-lo, hi] contra libm. Devuelve 0 si todas las cotas documentadas se cumplen.
+static int check_activations(){
+    const size_t N = 2000001;
+    vector<double> xs(N);
+    struct Case { const char* name; double a, b; bool rel; double bound;
+                  double (*ref)(double); void (*fast)(double*, size_t); };
+    const Case cases[] = {
+        {"exp",      -708.0, 709.0, true,  1e-15, [](double x){ return exp(x); },               exp_fast_inplace},
+        {"tanh",      -40.0,  40.0, false, 1e-15, [](double x){ return tanh(x); },              tanh_fast_inplace},
+        {"logistic",  -60.0,  60.0, false, 1e-15, [](double x){ return 1.0/(1.0+exp(-x)); },    logistic_fast_inplace},
+    };
+    int rc = 0;
+    cout.setf(std::ios::scientific); cout<<setprecision(3);
+    for(const auto& c: cases){
+        for(size_t i=0;i<N;++i) xs[i] = c.a + (c.b - c.a) * (double)i / (double)(N-1);
+        vector<double> y = xs;
+        c.fast(y.data(), y.size());
+        double max_err = 0.0, x_at = 0.0;
+        for(size_t i=0;i<N;++i){
+            double ref = c.ref(xs[i]);
+            double err = fabs(y[i] - ref);
+            if(c.rel) err /= fabs(ref);
+            if(!(err <= max_err)){ max_err = err; x_at = xs[i]; }
+        }
+        bool ok = max_err <= c.bound;
+        cout<<c.name<<": rango=["<<c.a<<","<<c.b<<"]  err_"<<(c.rel? "rel":"abs")<<"_max="<<max_err
+            <<" (x="<<x_at<<")  cota="<<c.bound<<"  "<<(ok? "OK":"FALLA")<<"\n";
+        if(!ok) rc = 1;
     }
-    y.swap(Y);
+    return rc;
 }
 
-/* -------------- métricas opcionales ---------- */
-static pair<double,double> mse_r2(const vector<double>& y, const vector<double>& yhat){
-    if(y.size()!=yhat.size()) throw runtime_error("mse_r2: tamaño distinto");
-    int n = (int)y.size();
-    double mse=0.0, mu=0.0;
-    for(double v: y) mu+=v; mu/=n;
-    double sst=0.0;
-    for(int i=0;i<n;++i){
-        double e = y[i]-yhat[i];
-        mse += e*e;
-        double d = y[i]-mu;
-        sst += d*d;
+// Tiempo por capa del forward con libm vs SIMD, para la activacion del bundle y para tanh/logistic.
+static int bench_activations(const Bundle& B0, const string& xy_path, int reps){
+    vector<double> X, y; int n=0, d=0;
+    read_xy_csv(xy_path, X, y, n, d);
+    if(d != B0.n_features){
+        cerr<<"[ERROR] d="<<d<<" != n_features del modelo "<<B0.n_features<<"\n";
+        return 1;
+    }
+    vector<string> acts = {B0.activation};
+    for(const char* a: {"tanh", "logistic"}) if(B0.activation!=a) acts.push_back(a);
+    cout.setf(std::ios::fixed); cout<<setprecision(4);
+    cout<<"filas="<<n<<"  reps="<<reps<<"  (ms por forward, promedio)\n";
+    for(const auto& act: acts){
+        Bundle B = B0; B.activation = act;
+        vector<double> ref = mlp_predict(B, X, n, ActImpl::Libm);
+        for(ActImpl impl: {ActImpl::Libm, ActImpl::Fast}){
+            LayerProf prof;
+            mlp_predict(B, X, n, impl);  // warmup
+            vector<double> yhat;
+            for(int r=0;r<reps;++r) yhat = mlp_predict(B, X, n, impl, &prof);
+            double max_diff = 0.0;
+            for(int i=0;i<n;++i) max_diff = max(max_diff, fabs(yhat[i]-ref[i]));
+            cout<<act<<" / "<<(impl==ActImpl::Libm? "libm":"fast")<<":";
+            double tot=0.0;
+            for(size_t li=0; li<prof.total_ms.size(); ++li){
+                cout<<"  L"<<li<<"="<<prof.total_ms[li]/reps<<" (act "<<prof.act_ms[li]/reps<<")";
+                tot += prof.total_ms[li]/reps;
+            }
+            cout<<"  total="<<tot<<"  max|dy|="<<scientific<<max_diff<<fixed<<"\n";
+        }
     }
-    mse/=n;
-    double r2 = (sst>0)? 1.0 - n*mse/sst : 0.0;
-    return {mse, r2};
+    return 0;
 }
 
 /* -------------- main ------------------------- */
 int main(int argc, char** argv){
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
+
+    // flags del modo streaming (se quitan antes de interpretar los posicionales)
+    bool stream = false;
+    StreamOpts sopt;
+    ofstream drift_file;
+    bool drift_flags = false;   // algun --drift*: solo valen con --eval
+    vector<string> args;
+    for(int i=0;i<argc;++i){
+        string a = argv[i];
+        auto need=[&](const char* name){ if(i+1>=argc){ cerr<<"Falta valor para "<<name<<"\n"; exit(1);} return string(argv[++i]); };
+        if(a=="--stream") stream = true;
+        else if(a=="--threads") sopt.threads = stoi(need("--threads"));
+        else if(a=="--chunk") sopt.chunk_rows = stoi(need("--chunk"));
+        else if(a=="--act"){
+            string v = need("--act");
+            if(v=="libm") sopt.act = ActImpl::Libm;
+            else if(v=="fast") sopt.act = ActImpl::Fast;
+            else { cerr<<"--act debe ser libm|fast\n"; return 1; }
+        }
+        else if(a=="--check_act") return check_activations();
+        else if(a=="--drift"){ sopt.drift.every = stoll(need("--drift")); drift_flags = true; }
+        else if(a=="--drift_window"){ sopt.drift.window = stoi(need("--drift_window")); drift_flags = true; }
+        else if(a=="--drift_halflife"){ sopt.drift.halflife = stod(need("--drift_halflife")); drift_flags = true; }
+        else if(a=="--drift_out"){
+            drift_flags = true;
+            string path = need("--drift_out");
+            drift_file.open(path);
+            if(!drift_file){ cerr<<"No se pudo abrir "<<path<<"\n"; return 1; }
+            sopt.drift_out = &drift_file;
+        }
+        else args.push_back(a);
+    }
+    argc = (int)args.size();
+    if(drift_flags){
+        if(sopt.drift.every<=0){ cerr<<"--drift_window/--drift_halflife/--drift_out requieren --drift N (N > 0)\n"; return 1; }
+        if(sopt.drift.window<=0 || !(sopt.drift.halflife>0)){ cerr<<"--drift_window y --drift_halflife deben ser > 0\n"; return 1; }
+        if(find(args.begin(), args.end(), "--eval")==args.end()){ cerr<<"--drift solo aplica con --eval (necesita y)\n"; return 1; }
+    }
+
     if(argc<2){
         cerr<<"Uso:\n"
             <<"  # solo inferencia (lee X de un CSV sin y)\n"
             <<"  ./mlp_infer_plain <mlp_bundle.txt> <X_only.csv>\n\n"
             <<"  # evaluar con xy_train.csv (ultima col y)\n"
-            <<"  ./mlp_infer_plain <mlp_bundle.txt> --eval xy_train.csv\n";
+            <<"  ./mlp_infer_plain <mlp_bundle.txt> --eval xy_train.csv\n\n"
+            <<"  # ensamble: varios bundles, X se parsea una vez; metricas por modelo y de la media\n"
+            <<"  ./mlp_infer_plain <b1.txt> <b2.txt> ... --eval xy_train.csv\n\n"
+            <<"  # pipeline parser/workers/writer con memoria acotada (archivos grandes)\n"
+            <<"  ./mlp_infer_plain <mlp_bundle.txt> [--eval] <csv> --stream [--threads N] [--chunk filas]\n\n"
+            <<"  # activaciones: --act libm|fast (SIMD); chequeo de error y bench por capa\n"
+            <<"  ./mlp_infer_plain --check_act\n"
+            <<"  ./mlp_infer_plain <mlp_bundle.txt> --bench_act xy_train.csv [reps]\n\n"
+            <<"  # monitor de drift en --eval (con varios bundles, sobre la media): linea de metricas cada N filas\n"
+            <<"  ./mlp_infer_plain <mlp_bundle.txt>... --eval xy_train.csv [--stream] --drift N [--drift_window W]\n"
+            <<"                    [--drift_halflife H] [--drift_out archivo]\n";
         return 1;
     }
-    string bundle_path = argv[1];
+    // varios bundles antes de --eval: ensamble en una sola pasada
+    {
+        auto it = find(args.begin(), args.end(), "--eval");
+        int eval_pos = int(it - args.begin());
+        if(it!=args.end() && eval_pos>2 && eval_pos+1<argc){
+            if(stream){ cerr<<"--stream no aplica con varios bundles (el ensamble ya lee X en tiles)\n"; return 1; }
+            vector<Bundle> models;
+            vector<string> names(args.begin()+1, it);
+            for(const auto& p: names) models.push_back(load_bundle_txt(p));
+            int n_print = (eval_pos+2<argc)? stoi(args[eval_pos+2]) : 5;
+            return ensemble_eval(models, names, args[eval_pos+1], n_print, sopt.act, sopt.drift, *sopt.drift_out);
+        }
+    }
+
+    string bundle_path = args[1];
     Bundle B = load_bundle_txt(bundle_path);
 
-    if(argc>=4 && string(argv[2])=="--eval"){
-        string xy_path = argv[3];
+    if(argc>=4 && args[2]=="--bench_act")
+        return bench_activations(B, args[3], argc>=5? stoi(args[4]) : 20);
+
+    if(stream && argc>=3){
+        bool eval = (args[2]=="--eval");
+        if(eval && argc<4){ cerr<<"Argumentos insuficientes.\n"; return 1; }
+        if(eval && argc>=5) sopt.n_print = stoi(args[4]);
+        return stream_predict(B, eval? args[3] : args[2], eval, sopt);
+    }
+
+    if(argc>=4 && args[2]=="--eval"){
+        string xy_path = args[3];
         vector<double> X, y; int n=0, d=0;
         read_xy_csv(xy_path, X, y, n, d);
         if(d != B.n_features){
@@ -241,11 +535,16 @@ int main(int argc, char** argv){
 
         // medir tiempo de inferencia
         auto t0 = chrono::high_resolution_clock::now();
-        auto yhat = mlp_predict(B, X, n);
+        auto yhat = mlp_predict(B, X, n, sopt.act);
         auto t1 = chrono::high_resolution_clock::now();
 
         // calcular métricas
         auto [mse, r2] = mse_r2(y, yhat);
+        if(sopt.drift.every){
+            DriftMonitor dm(sopt.drift, *sopt.drift_out);
+            for(int i=0;i<n;++i) dm.add(y[i], yhat[i]);
+            if(n % sopt.drift.every) dm.report();
+        }
         cout.setf(std::ios::fixed); cout<<setprecision(10);
         
 
@@ -257,7 +556,7 @@ int main(int argc, char** argv){
 
         // cantidad a imprimir (por defecto 5)
         int n_print = 5;
-        if(argc >= 5) n_print = stoi(argv[4]);
+        if(argc >= 5) n_print = stoi(args[4]);
 
         for(int i=0;i<min(n,n_print);++i){
             cout<<"i="<<i<<"  y="<<y[i]<<"  yhat="<<yhat[i]<<"\n";
@@ -270,7 +569,7 @@ int main(int argc, char** argv){
 
     else if(argc>=3){
         // caso: X_only.csv (sin y), con header
-        string x_path = argv[2];
+        string x_path = args[2];
         ifstream fin(x_path);
         if(!fin){ cerr<<"No se pudo abrir "<<x_path<<"\n"; return 1; }
         string header; if(!getline(fin, header)){ cerr<<"CSV vacio\n"; return 1; }
@@ -282,14 +581,17 @@ int main(int argc, char** argv){
         }
         vector<double> X; X.reserve(1<<20);
         string line;
-        while(getline(fin, line)){
-            line = trim(line); if(line.empty()) continue;
-            auto v = parse_floats_csv_line(line);
-            if((int)v.size()!=d){ cerr<<"Fila con columnas != d\n"; return 1; }
-            X.insert(X.end(), v.begin(), v.end());
+        {
+            TRACE_SCOPE("parse");
+            while(getline(fin, line)){
+                line = trim(line); if(line.empty()) continue;
+                auto v = parse_floats_csv_line(line);
+                if((int)v.size()!=d){ cerr<<"Fila con columnas != d\n"; return 1; }
+                X.insert(X.end(), v.begin(), v.end());
+            }
         }
         int n = (int)X.size()/d;
-        auto yhat = mlp_predict(B, X, n);
+        auto yhat = mlp_predict(B, X, n, sopt.act);
         cout.setf(std::ios::fixed); cout<<setprecision(10);
         for(double v: yhat) cout<<v<<"\n";
         return 0;
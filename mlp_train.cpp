@@ -0,0 +1,311 @@
+// mlp_train.cpp — entrena el MLP en C++ y escribe un mlp_bundle.txt compatible con mlp_infer_plain.
+// StandardScaler + MLP (activacion en ocultas, salida lineal) con Adam en mini-batches.
+// Gradiente data-parallel: cada batch se parte en rangos contiguos, un hilo por rango,
+// y los gradientes se suman en orden fijo de hilo (resultado determinista para un --seed y --threads).
+#include "mlp_core.hpp"
+
+/* -------------- pool de hilos persistente ---- */
+// run(f) ejecuta f(tid) en todos los hilos (el llamador es tid 0) y espera a que terminen.
+class WorkerPool {
+public:
+    explicit WorkerPool(int n): n_(max(1,n)) {
+        for(int t=1;t<n_;++t) th_.emplace_back([this,t]{ loop(t); });
+    }
+    ~WorkerPool(){
+        { lock_guard<mutex> lk(mu_); stop_ = true; ++gen_; }
+        cv_.notify_all();
+        for(auto& t: th_) t.join();
+    }
+    int size() const { return n_; }
+    void run(const function<void(int)>& f){
+        {
+            lock_guard<mutex> lk(mu_);
+            job_ = &f; pending_ = n_-1; ++gen_;
+        }
+        cv_.notify_all();
+        f(0);
+        unique_lock<mutex> lk(mu_);
+        done_cv_.wait(lk, [&]{ return pending_==0; });
+        job_ = nullptr;
+    }
+private:
+    void loop(int tid){
+        long long seen = 0;
+        while(true){
+            const function<void(int)>* job;
+            {
+                unique_lock<mutex> lk(mu_);
+                cv_.wait(lk, [&]{ return gen_!=seen; });
+                seen = gen_;
+                if(stop_) return;
+                job = job_;
+            }
+            (*job)(tid);
+            {
+                lock_guard<mutex> lk(mu_);
+                if(--pending_==0) done_cv_.notify_one();
+            }
+        }
+    }
+    int n_;
+    vector<thread> th_;
+    mutex mu_;
+    condition_variable cv_, done_cv_;
+    const function<void(int)>* job_=nullptr;
+    int pending_=0;
+    long long gen_=0;
+    bool stop_=false;
+};
+
+/* -------------- buffers por hilo ------------- */
+struct ThreadWork {
+    vector<vector<double>> A;   // A[0]=entrada, A[l+1]=salida de la capa l (post-activacion)
+    vector<vector<double>> dA;  // gradiente respecto de A[l+1]
+    vector<Layer> grad;         // dW, db acumulados del sub-batch
+    double loss=0.0;
+};
+
+// Z[m x out] = A[m x in] * W[in x out] + b
+static void gemm_fwd(const double* A, int m, int in, const Layer& L, double* Z){
+    const int out = L.out_f;
+    for(int r=0;r<m;++r){
+        double* z = Z + (size_t)r*out;
+        for(int c=0;c<out;++c) z[c] = L.b[c];
+        const double* a = A + (size_t)r*in;
+        for(int k=0;k<in;++k){
+            const double ak = a[k];
+            const double* w = &L.W[(size_t)k*out];
+            for(int c=0;c<out;++c) z[c] += ak * w[c];
+        }
+    }
+}
+
+// Forward + backward de las m filas idx[0..m); acumula dW/db y loss = 0.5*sum(e^2) en w (sin normalizar)
+static void forward_backward(const Bundle& B, const vector<double>& Xs, const vector<double>& y,
+                             const int* idx, int m, ThreadWork& w){
+    const int nf = B.n_features;
+    const size_t NL = B.layers.size();
+    w.A[0].resize((size_t)m*nf);
+    for(int r=0;r<m;++r) memcpy(&w.A[0][(size_t)r*nf], &Xs[(size_t)idx[r]*nf], sizeof(double)*nf);
+    for(size_t l=0;l<NL;++l){
+        const Layer& L = B.layers[l];
+        w.A[l+1].resize((size_t)m*L.out_f);
+        gemm_fwd(w.A[l].data(), m, L.in_f, L, w.A[l+1].data());
+        if(l+1<NL) activation_inplace(B.activation, w.A[l+1], ActImpl::Libm);
+    }
+    // salida lineal (out_f=1): dL/dyhat = yhat - y
+    auto& dOut = w.dA[NL-1];
+    dOut.resize(m);
+    for(int r=0;r<m;++r){
+        double e = w.A[NL][r] - y[idx[r]];
+        w.loss += 0.5*e*e;
+        dOut[r] = e;
+    }
+    for(size_t l=NL; l-- > 0;){
+        const Layer& L = B.layers[l];
+        Layer& G = w.grad[l];
+        vector<double>& dZ = w.dA[l];     // en capas ocultas se transforma in situ dA -> dZ
+        if(l+1<NL){
+            const vector<double>& Aout = w.A[l+1];
+            if(B.activation=="relu")          for(size_t i=0;i<dZ.size();++i){ if(Aout[i]<=0.0) dZ[i]=0.0; }
+            else if(B.activation=="tanh")     for(size_t i=0;i<dZ.size();++i) dZ[i] *= 1.0 - Aout[i]*Aout[i];
+            else if(B.activation=="logistic") for(size_t i=0;i<dZ.size();++i) dZ[i] *= Aout[i]*(1.0 - Aout[i]);
+        }
+        const double* Ain = w.A[l].data();
+        for(int r=0;r<m;++r){
+            const double* dz = &dZ[(size_t)r*L.out_f];
+            const double* a  = Ain + (size_t)r*L.in_f;
+            for(int k=0;k<L.in_f;++k){
+                const double ak = a[k];
+                double* g = &G.W[(size_t)k*L.out_f];
+                for(int c=0;c<L.out_f;++c) g[c] += ak * dz[c];
+            }
+            for(int c=0;c<L.out_f;++c) G.b[c] += dz[c];
+        }
+        if(l>0){
+            auto& dPrev = w.dA[l-1];
+            dPrev.assign((size_t)m*L.in_f, 0.0);
+            for(int r=0;r<m;++r){
+                const double* dz = &dZ[(size_t)r*L.out_f];
+                double* dp = &dPrev[(size_t)r*L.in_f];
+                for(int k=0;k<L.in_f;++k){
+                    const double* wk = &L.W[(size_t)k*L.out_f];
+                    double acc = 0.0;
+                    for(int c=0;c<L.out_f;++c) acc += wk[c]*dz[c];
+                    dp[k] = acc;
+                }
+            }
+        }
+    }
+}
+
+static vector<int> parse_int_list(const string& s){
+    vector<int> v;
+    for(auto& t: split(s, ',')){ t = trim(t); if(!t.empty()) v.push_back(stoi(t)); }
+    return v;
+}
+
+int main(int argc, char** argv){
+    string xy_path = "xy_train.csv";
+    string out_path = "mlp_bundle.txt";
+    string activation = "relu";
+    vector<int> hidden = {32, 16};
+    int epochs = 200, batch = 256;
+    double lr = 1e-3, alpha = 1e-4, val_frac = 0.1;
+    int threads = max(1u, thread::hardware_concurrency());
+    unsigned long long seed = 42;
+    int log_every = 10;
+
+    for(int i=1;i<argc;i++){
+        string a = argv[i];
+        auto need=[&](const char* name){ if(i+1>=argc){ cerr<<"Falta valor para "<<name<<"\n"; exit(1);} return string(argv[++i]); };
+        if(a=="--xy") xy_path = need("--xy");
+        else if(a=="--out") out_path = need("--out");
+        else if(a=="--activation") activation = need("--activation");
+        else if(a=="--hidden") hidden = parse_int_list(need("--hidden"));
+        else if(a=="--epochs") epochs = stoi(need("--epochs"));
+        else if(a=="--batch") batch = stoi(need("--batch"));
+        else if(a=="--lr") lr = stod(need("--lr"));
+        else if(a=="--alpha") alpha = stod(need("--alpha"));
+        else if(a=="--val_frac") val_frac = stod(need("--val_frac"));
+        else if(a=="--threads") threads = stoi(need("--threads"));
+        else if(a=="--seed") seed = stoull(need("--seed"));
+        else if(a=="--log_every") log_every = stoi(need("--log_every"));
+        else { cerr<<"Arg desconocido: "<<a<<"\n"; return 1; }
+    }
+    if(activation!="relu" && activation!="tanh" && activation!="logistic"){
+        cerr<<"--activation debe ser relu|tanh|logistic\n"; return 1;
+    }
+    if(batch<=0 || epochs<=0 || log_every<=0){ cerr<<"--batch, --epochs y --log_every deben ser > 0\n"; return 1; }
+    for(int h: hidden) if(h<=0){ cerr<<"--hidden: cada tamaño de capa debe ser > 0 (recibido "<<h<<")\n"; return 1; }
+
+    auto t_start = chrono::steady_clock::now();
+    vector<double> X, y; int n=0, d=0;
+    read_xy_csv(xy_path, X, y, n, d);
+    if(n<2 || d<=0){ cerr<<"Muy pocas filas en "<<xy_path<<"\n"; return 1; }
+
+    // split temporal: las ultimas val_frac filas quedan como validacion
+    int n_val = (int)floor(n*max(0.0, min(val_frac, 0.5)));
+    int n_tr  = n - n_val;
+
+    // StandardScaler (ddof=0, scale=1 si varianza nula, como sklearn) sobre train
+    Bundle B;
+    B.activation = activation;
+    B.n_features = d;
+    B.scaler_mean.assign(d, 0.0);
+    B.scaler_scale.assign(d, 0.0);
+    for(int r=0;r<n_tr;++r) for(int c=0;c<d;++c) B.scaler_mean[c] += X[(size_t)r*d+c];
+    for(int c=0;c<d;++c) B.scaler_mean[c] /= n_tr;
+    for(int r=0;r<n_tr;++r) for(int c=0;c<d;++c){
+        double v = X[(size_t)r*d+c] - B.scaler_mean[c];
+        B.scaler_scale[c] += v*v;
+    }
+    for(int c=0;c<d;++c){
+        double s = sqrt(B.scaler_scale[c]/n_tr);
+        B.scaler_scale[c] = (s>0.0)? s : 1.0;
+    }
+    vector<double> Xs((size_t)n*d);
+    for(int r=0;r<n;++r) for(int c=0;c<d;++c)
+        Xs[(size_t)r*d+c] = (X[(size_t)r*d+c] - B.scaler_mean[c]) / B.scaler_scale[c];
+
+    // init Glorot uniforme (factor 2 para logistic), igual que sklearn
+    mt19937_64 rng(seed);
+    vector<int> dims = {d};
+    dims.insert(dims.end(), hidden.begin(), hidden.end());
+    dims.push_back(1);
+    for(size_t l=0;l+1<dims.size();++l){
+        Layer L; L.in_f = dims[l]; L.out_f = dims[l+1];
+        double bound = sqrt((activation=="logistic"? 2.0 : 6.0) / (L.in_f + L.out_f));
+        uniform_real_distribution<double> U(-bound, bound);
+        L.W.resize((size_t)L.in_f*L.out_f);
+        L.b.resize(L.out_f);
+        for(double& v: L.W) v = U(rng);
+        for(double& v: L.b) v = U(rng);
+        B.layers.push_back(move(L));
+    }
+    const size_t NL = B.layers.size();
+
+    // estado de Adam con la misma forma que las capas
+    vector<Layer> mom = B.layers, vel = B.layers, gsum = B.layers;
+    for(auto* P: {&mom, &vel}) for(auto& L: *P){ fill(L.W.begin(), L.W.end(), 0.0); fill(L.b.begin(), L.b.end(), 0.0); }
+    const double beta1 = 0.9, beta2 = 0.999, eps = 1e-8;
+    long long step = 0;
+
+    WorkerPool pool(threads);
+    const int T = pool.size();
+    vector<ThreadWork> work(T);
+    for(auto& w: work){
+        w.A.resize(NL+1); w.dA.resize(NL);
+        w.grad = B.layers;
+    }
+
+    vector<double> Xval(X.begin() + (size_t)n_tr*d, X.end());
+    vector<double> yval(y.begin() + n_tr, y.end());
+    Bundle best = B; double best_val = numeric_limits<double>::infinity();
+
+    vector<int> order(n_tr);
+    iota(order.begin(), order.end(), 0);
+    cout.setf(std::ios::fixed); cout<<setprecision(8);
+    cerr<<"train="<<n_tr<<" val="<<n_val<<" d="<<d<<" capas="<<NL<<" threads="<<T<<"\n";
+
+    for(int ep=1; ep<=epochs; ++ep){
+        shuffle(order.begin(), order.end(), rng);
+        double ep_loss = 0.0;
+        for(int b0=0; b0<n_tr; b0+=batch){
+            const int bs = min(batch, n_tr - b0);
+            const int* idx = &order[b0];
+            pool.run([&](int tid){
+                ThreadWork& w = work[tid];
+                for(auto& G: w.grad){ fill(G.W.begin(), G.W.end(), 0.0); fill(G.b.begin(), G.b.end(), 0.0); }
+                w.loss = 0.0;
+                int r0 = (int)((long long)bs*tid/T), r1 = (int)((long long)bs*(tid+1)/T);
+                if(r1>r0) forward_backward(B, Xs, y, idx + r0, r1 - r0, w);
+            });
+            // reduccion en orden fijo de hilo + L2 (alpha/bs * W, como sklearn)
+            ++step;
+            const double c1 = 1.0 - pow(beta1, (double)step), c2 = 1.0 - pow(beta2, (double)step);
+            for(size_t l=0;l<NL;++l){
+                Layer& G = gsum[l];
+                G.W = work[0].grad[l].W; G.b = work[0].grad[l].b;
+                for(int t=1;t<T;++t){
+                    for(size_t i=0;i<G.W.size();++i) G.W[i] += work[t].grad[l].W[i];
+                    for(size_t i=0;i<G.b.size();++i) G.b[i] += work[t].grad[l].b[i];
+                }
+                Layer& P = B.layers[l];
+                auto adam=[&](vector<double>& p, vector<double>& g, vector<double>& m, vector<double>& v, bool decay){
+                    for(size_t i=0;i<p.size();++i){
+                        double gi = g[i]/bs + (decay? alpha*p[i]/bs : 0.0);
+                        m[i] = beta1*m[i] + (1.0-beta1)*gi;
+                        v[i] = beta2*v[i] + (1.0-beta2)*gi*gi;
+                        p[i] -= lr * (m[i]/c1) / (sqrt(v[i]/c2) + eps);
+                    }
+                };
+                adam(P.W, G.W, mom[l].W, vel[l].W, true);
+                adam(P.b, G.b, mom[l].b, vel[l].b, false);
+            }
+            for(int t=0;t<T;++t) ep_loss += work[t].loss;
+        }
+        ep_loss /= n_tr;
+
+        bool last = (ep==epochs);
+        if(n_val>0){
+            auto yhat = mlp_predict(B, Xval, n_val);
+            auto [mse, r2] = mse_r2(yval, yhat);
+            if(mse < best_val){ best_val = mse; best = B; }
+            if(ep%log_every==0 || last)
+                cout<<"epoch="<<ep<<"  loss="<<ep_loss<<"  val_MSE="<<mse<<"  val_R2="<<r2<<"\n";
+        }else{
+            best = B;
+            if(ep%log_every==0 || last) cout<<"epoch="<<ep<<"  loss="<<ep_loss<<"\n";
+        }
+    }
+
+    save_bundle_txt(best, out_path);
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t_start).count();
+    auto yhat = mlp_predict(best, X, n);
+    auto [mse, r2] = mse_r2(y, yhat);
+    cout<<"\nBundle escrito en: "<<out_path<<(n_val>0? " (mejor epoch por val_MSE)":"")<<"\n";
+    cout<<"MSE(total)="<<mse<<"  R2(total)="<<r2<<"\n";
+    cout<<"Tiempo total: "<<secs<<" s\n";
+    return 0;
+}
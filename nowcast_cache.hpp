@@ -0,0 +1,240 @@
+// nowcast_cache.hpp — cache en disco de series y columnas de ajuste para get_nowcast (--cache_dir).
+//
+// Un archivo por (hash del contenido de df_all, k_last): <dir>/nowcast_<hash>_k<k>.ncc
+// El hash de df_all se recuerda en <dir>/df_hashes.txt por (path, tamaño, mtime): solo se relee el
+// archivo completo si cambio alguno de los dos (cached_file_hash).
+// Layout (little-endian, todo alineado a 8 bytes; se mapea con mmap: las columnas se usan sin copiar,
+// las series se copian a vector<TP> en trade_map() porque el resto del pipeline trabaja con vectores):
+//   header : "NCC1" | u32 version | u64 df_hash | u32 k_last | u32 n_records
+//   records: u32 kind | u32 name_len | u64 n | name (padding a 8) | datos
+//            kind 1 = serie TRADE deduplicada de un instrumento: n x TP{t, v}
+//            kind 2 = columna de ajustes "target\tinstrumento": n doubles p y n doubles m
+//                     (n = puntos del target, NaN donde no hay ajuste; ver fit_column)
+// Lo que falta se calcula y se agrega reescribiendo el archivo en un temporal + rename,
+// asi un lector concurrente nunca ve un archivo a medio escribir.
+#pragma once
+#include "nowcast_core.hpp"
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char NCC_MAGIC[4] = {'N','C','C','1'};
+static const uint32_t NCC_VERSION = 1;
+enum : uint32_t { NCC_SERIES = 1, NCC_COLUMN = 2 };
+
+// Hash del contenido (palabras de 8 bytes, mezcla tipo FNV + xorshift); no criptografico.
+static const uint64_t NCC_HASH_SEED = 0xcbf29ce484222325ULL;
+static inline uint64_t hash_mix(uint64_t h, const unsigned char* p, size_t n){
+    size_t i = 0;
+    for(; i+8<=n; i+=8){
+        uint64_t w; memcpy(&w, p+i, 8);
+        h = (h ^ w) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    for(; i<n; ++i) h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h;
+}
+static inline uint64_t hash_string(const string& s){
+    return hash_mix(NCC_HASH_SEED, (const unsigned char*)s.data(), s.size()) ^ s.size();
+}
+static inline bool hash_file(const string& path, uint64_t& h){
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f) return false;
+    h = NCC_HASH_SEED;
+    vector<unsigned char> buf(1<<20);   // multiplo de 8: mismo hash que hash_mix sobre todo el archivo
+    size_t n;
+    uint64_t total = 0;
+    while((n = fread(buf.data(), 1, buf.size(), f)) > 0){
+        total += n;
+        h = hash_mix(h, buf.data(), n);
+    }
+    fclose(f);
+    h ^= total;
+    return true;
+}
+
+// hash_file de path, reusando el de <dir>/df_hashes.txt si tamaño y mtime (ns) no cambiaron.
+// Lineas: "hash size mtime path" (path al final: puede tener espacios).
+static inline bool cached_file_hash(const string& dir, const string& path, uint64_t& h){
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const string abs = fs::absolute(path, ec).lexically_normal().string();
+    const auto size = fs::file_size(path, ec);
+    if(ec) return false;
+    const auto mt = fs::last_write_time(path, ec);
+    if(ec) return false;
+    const long long mtime = (long long)mt.time_since_epoch().count();
+
+    const string idx = dir + "/df_hashes.txt";
+    vector<string> keep;
+    {
+        ifstream fin(idx);
+        string line;
+        while(getline(fin, line)){
+            unsigned long long hh, sz; long long mtm; int off = 0;
+            if(sscanf(line.c_str(), "%llx %llu %lld %n", &hh, &sz, &mtm, &off) < 3 || off==0) continue;
+            if(line.compare(off, string::npos, abs) != 0){ keep.push_back(line); continue; }
+            if(sz==(unsigned long long)size && mtm==mtime){ h = hh; return true; }
+        }
+    }
+    if(!hash_file(path, h)) return false;
+    char buf[64];
+    snprintf(buf, sizeof buf, "%016llx %llu %lld ", (unsigned long long)h, (unsigned long long)size, mtime);
+    keep.push_back(buf + abs);
+    mkdir(dir.c_str(), 0755);
+    const string tmp = idx + ".tmp." + to_string(getpid());
+    {
+        ofstream fout(tmp);
+        for(const auto& l: keep) fout << l << "\n";
+        if(!fout){ remove(tmp.c_str()); return true; }   // sin indice igual hay hash
+    }
+    if(rename(tmp.c_str(), idx.c_str())!=0) remove(tmp.c_str());
+    return true;
+}
+
+class NowcastCache {
+public:
+    NowcastCache() = default;
+    NowcastCache(const NowcastCache&) = delete;
+    NowcastCache& operator=(const NowcastCache&) = delete;
+    ~NowcastCache(){ if(base_) munmap((void*)base_, size_); }
+
+    // Mapea el archivo del cache si existe y corresponde a (df_hash, k_last); si no, queda vacio.
+    void open(const string& dir, uint64_t df_hash, int k_last){
+        char name[64];
+        snprintf(name, sizeof name, "nowcast_%016llx_k%d.ncc", (unsigned long long)df_hash, k_last);
+        dir_ = dir; path_ = dir + "/" + name;
+        hash_ = df_hash; k_last_ = k_last;
+        int fd = ::open(path_.c_str(), O_RDONLY);
+        if(fd < 0) return;
+        struct stat st;
+        if(fstat(fd, &st)==0 && st.st_size >= 24){
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p != MAP_FAILED){ base_ = (const unsigned char*)p; size_ = (size_t)st.st_size; }
+        }
+        close(fd);
+        if(base_ && !index_records()){
+            cerr<<"[cache] archivo invalido, se regenera: "<<path_<<"\n";
+            series_.clear(); columns_.clear(); n_mapped_ = 0;
+        }
+    }
+
+    bool has_series() const { return !series_.empty(); }
+
+    unordered_map<string, vector<TP>> trade_map() const {
+        unordered_map<string, vector<TP>> tm;
+        for(const auto& kv: series_) tm.emplace(kv.first, vector<TP>(kv.second.first, kv.second.first + kv.second.second));
+        return tm;
+    }
+
+    void put_series(const unordered_map<string, vector<TP>>& tm){
+        for(const auto& kv: tm) new_series_.push_back(kv);
+    }
+
+    // Columna de ajustes de inst en los tiempos del target; si no esta en el cache se calcula y queda pendiente.
+    FitColumnView column(const string& target, const string& inst, const vector<TP>& tar, const vector<TP>& s){
+        const string key = target + "\t" + inst;
+        auto it = columns_.find(key);
+        if(it!=columns_.end() && it->second.second==tar.size()){
+            ++hits_;
+            return {it->second.first, it->second.first + tar.size()};
+        }
+        ++misses_;
+        new_columns_.emplace_back(key, fit_column(s, tar, k_last_));
+        const auto& c = new_columns_.back().second;
+        return {c.p.data(), c.m.data()};
+    }
+
+    int hits() const { return hits_; }
+    int misses() const { return misses_; }
+
+    // Reescribe el archivo con los records mapeados + los pendientes (temporal + rename).
+    bool flush(string& err){
+        if(new_series_.empty() && new_columns_.empty()) return true;
+        mkdir(dir_.c_str(), 0755);
+        const string tmp = path_ + ".tmp." + to_string(getpid());
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if(!f){ err = "No se pudo abrir " + tmp; return false; }
+        uint32_t n_rec = n_mapped_ + (uint32_t)new_series_.size() + (uint32_t)new_columns_.size();
+        uint32_t k = (uint32_t)k_last_;
+        fwrite(NCC_MAGIC, 1, 4, f);
+        fwrite(&NCC_VERSION, 4, 1, f);
+        fwrite(&hash_, 8, 1, f);
+        fwrite(&k, 4, 1, f);
+        fwrite(&n_rec, 4, 1, f);
+        if(n_mapped_) fwrite(base_ + 24, 1, records_end_ - 24, f);
+        for(const auto& kv: new_series_)
+            write_record(f, NCC_SERIES, kv.first, kv.second.size(), kv.second.data(), kv.second.size()*sizeof(TP), nullptr, 0);
+        for(const auto& kv: new_columns_)
+            write_record(f, NCC_COLUMN, kv.first, kv.second.p.size(), kv.second.p.data(), kv.second.p.size()*8,
+                         kv.second.m.data(), kv.second.m.size()*8);
+        bool ok = !ferror(f);
+        ok = (fclose(f)==0) && ok;
+        if(!ok || rename(tmp.c_str(), path_.c_str())!=0){
+            remove(tmp.c_str());
+            err = "No se pudo escribir " + path_;
+            return false;
+        }
+        return true;
+    }
+
+    const string& path() const { return path_; }
+
+private:
+    static void write_record(FILE* f, uint32_t kind, const string& name, uint64_t n,
+                             const void* a, size_t a_bytes, const void* b, size_t b_bytes){
+        static const char pad[8] = {0};
+        uint32_t len = (uint32_t)name.size();
+        fwrite(&kind, 4, 1, f);
+        fwrite(&len, 4, 1, f);
+        fwrite(&n, 8, 1, f);
+        fwrite(name.data(), 1, len, f);
+        fwrite(pad, 1, (8 - len % 8) % 8, f);
+        if(a_bytes) fwrite(a, 1, a_bytes, f);
+        if(b_bytes) fwrite(b, 1, b_bytes, f);
+    }
+
+    bool index_records(){
+        const unsigned char* p = base_;
+        if(memcmp(p, NCC_MAGIC, 4)!=0) return false;
+        uint32_t ver, k, n_rec; uint64_t h;
+        memcpy(&ver, p+4, 4); memcpy(&h, p+8, 8); memcpy(&k, p+16, 4); memcpy(&n_rec, p+20, 4);
+        if(ver!=NCC_VERSION || h!=hash_ || (int)k!=k_last_) return false;
+        size_t off = 24;
+        for(uint32_t r=0; r<n_rec; ++r){
+            if(off + 16 > size_) return false;
+            uint32_t kind, len; uint64_t n;
+            memcpy(&kind, p+off, 4); memcpy(&len, p+off+4, 4); memcpy(&n, p+off+8, 8);
+            off += 16;
+            // largos del archivo sin multiplicar antes de acotarlos (n corrupto no debe desbordar)
+            const size_t name_bytes = (size_t)len + (8 - len % 8) % 8;
+            if(name_bytes > size_ - off) return false;
+            const size_t rec = (kind==NCC_SERIES? sizeof(TP) : 16);
+            if(n > (size_ - off - name_bytes) / rec) return false;
+            const size_t data_bytes = rec * n;
+            string name((const char*)p+off, len);
+            off += name_bytes;
+            if(kind==NCC_SERIES) series_[name] = {(const TP*)(p+off), n};
+            else if(kind==NCC_COLUMN) columns_[name] = {(const double*)(p+off), n};
+            else return false;
+            off += data_bytes;
+        }
+        n_mapped_ = n_rec;
+        records_end_ = off;
+        return true;
+    }
+
+    string dir_, path_;
+    uint64_t hash_ = 0;
+    int k_last_ = 0;
+    const unsigned char* base_ = nullptr;
+    size_t size_ = 0, records_end_ = 24;
+    uint32_t n_mapped_ = 0;
+    unordered_map<string, pair<const TP*, size_t>> series_;
+    unordered_map<string, pair<const double*, size_t>> columns_;   // p; m sigue a continuacion
+    vector<pair<string, vector<TP>>> new_series_;
+    deque<pair<string, FitColumn>> new_columns_;   // deque: las vistas devueltas siguen validas
+    int hits_ = 0, misses_ = 0;
+};
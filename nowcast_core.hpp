@@ -0,0 +1,367 @@
+// nowcast_core.hpp — lectura de df_all, ajuste local de rectas y ecuaciones normales (get_nowcast).
+#pragma once
+#include "csv_util.hpp"
+#include "trace.hpp"
+
+struct DFRow {
+    string instrument;
+    string side;
+    long long fecha_nano;
+    double ts_sec;
+    double vwap;
+    double mid = NaN, microprice = NaN, quote_spread = NaN, imbalance = NaN;   // columnas opcionales (--book)
+};
+struct TP { double t; double v; };
+
+// indices de columnas de df_all a partir del header
+struct DFCols {
+    int inst=-1, side=-1, fn=-1, ts=-1, vwap=-1;
+    int mid=-1, micro=-1, qspr=-1, imb=-1;   // opcionales: process_market --book
+    bool has_book() const { return mid>=0 && micro>=0 && qspr>=0 && imb>=0; }
+};
+static inline bool df_all_cols(const string& header, DFCols& c){
+    auto cols = split_csv(header);
+    for(auto& x: cols) x=trim(x);
+    for(int i=0;i<(int)cols.size();++i){
+        if(cols[i]=="instrument") c.inst=i;
+        else if(cols[i]=="side") c.side=i;
+        else if(cols[i]=="fecha_nano") c.fn=i;
+        else if(cols[i]=="ts_sec") c.ts=i;
+        else if(cols[i]=="vwap") c.vwap=i;
+        else if(cols[i]=="mid") c.mid=i;
+        else if(cols[i]=="microprice") c.micro=i;
+        else if(cols[i]=="quote_spread") c.qspr=i;
+        else if(cols[i]=="imbalance") c.imb=i;
+    }
+    if(c.inst<0||c.side<0||c.fn<0||c.ts<0||c.vwap<0){
+        cerr<<"df_all.csv no tiene columnas requeridas.\n";
+        return false;
+    }
+    return true;
+}
+
+static inline void parse_df_all_line(const string& line, const DFCols& c, vector<DFRow>& rows){
+    if(trim(line).empty()) return;
+    auto t = split_csv(line);
+    const int last = max({c.inst,c.side,c.fn,c.ts,c.vwap,c.mid,c.micro,c.qspr,c.imb});
+    if((int)t.size()<=last) t.resize(last+1);
+    DFRow r;
+    r.instrument = trim(t[c.inst]);
+    r.side       = trim(t[c.side]);
+    to_int64(t[c.fn], r.fecha_nano);
+    to_double(t[c.ts], r.ts_sec);
+    to_double(t[c.vwap], r.vwap);
+    if(c.has_book()){
+        to_double(t[c.mid], r.mid);
+        to_double(t[c.micro], r.microprice);
+        to_double(t[c.qspr], r.quote_spread);
+        to_double(t[c.imb], r.imbalance);
+    }
+    rows.push_back(move(r));
+}
+
+static inline bool read_df_all(const string& path, vector<DFRow>& rows){
+    TRACE_SCOPE("load");
+    ifstream fin(path);
+    if(!fin) return false;
+    string header; if(!getline(fin, header)) return false;
+    DFCols c;
+    if(!df_all_cols(header, c)) return false;
+    string line;
+    while(getline(fin, line)) parse_df_all_line(line, c, rows);
+    TRACE_COUNTER("rows_parsed", rows.size());
+    return true;
+}
+
+// Solo las filas en [byte_begin, byte_end) (rango de manifest.csv); el header se lee igual para
+// ubicar las columnas.
+static inline bool read_df_all_range(const string& path, long long byte_begin, long long byte_end,
+                                     vector<DFRow>& rows){
+    TRACE_SCOPE("load_range");
+    ifstream fin(path, ios::binary);
+    if(!fin) return false;
+    string header; if(!getline(fin, header)) return false;
+    DFCols c;
+    if(!df_all_cols(header, c)) return false;
+    string buf(max(0LL, byte_end - byte_begin), '\0');
+    fin.seekg(byte_begin);
+    if(!fin.read(&buf[0], buf.size())) return false;
+    const size_t n0 = rows.size();
+    istringstream in(buf);
+    string line;
+    while(getline(in, line)) parse_df_all_line(line, c, rows);
+    TRACE_COUNTER("rows_parsed", rows.size() - n0);
+    return true;
+}
+
+static inline bool solve_linear(vector<vector<double>>& A, vector<double>& b, vector<double>& x){
+    TRACE_SCOPE("solve");
+    int n = (int)A.size();
+    x.assign(n,0.0);
+    for(int i=0;i<n;i++) A[i].push_back(b[i]);
+    for(int col=0; col<n; ++col){
+        int piv = col;
+        double best = fabs(A[col][col]);
+        for(int r=col+1; r<n; ++r){
+            double v=fabs(A[r][col]);
+            if(v>best){ best=v; piv=r; }
+        }
+        if(best<1e-14) return false;
+        if(piv!=col) swap(A[piv], A[col]);
+        double div = A[col][col];
+        for(int j=col;j<=n;j++) A[col][j] /= div;
+        for(int r=0;r<n;r++){
+            if(r==col) continue;
+            double factor = A[r][col];
+            if(fabs(factor)<1e-15) continue;
+            for(int j=col;j<=n;j++) A[r][j] -= factor*A[col][j];
+        }
+    }
+    for(int i=0;i<n;i++) x[i]=A[i][n];
+    return true;
+}
+
+static inline bool fit_line_lastk_at_t(const vector<TP>& s, double t, int k_last, double& y_t, double& slope){
+    if((int)s.size()<k_last) return false;
+    auto it = upper_bound(s.begin(), s.end(), t, [](double val, const TP& P){ return val < P.t; });
+    int end = int(it - s.begin()) - 1;
+    if(end < 0) return false;
+    int start = end - (k_last - 1);
+    if(start < 0) return false;
+    double xm = 0.0; for(int i=start;i<=end;i++) xm += s[i].t; xm /= k_last;
+    double S00=0, S01=0, S11=0, b0=0, b1=0;
+    for(int i=start;i<=end;i++){
+        double xc = s[i].t - xm;
+        double yi = s[i].v;
+        S00 += 1.0;
+        S01 += xc;
+        S11 += xc*xc;
+        b0  += yi;
+        b1  += xc*yi;
+    }
+    double det = S00*S11 - S01*S01;
+    if(fabs(det) < 1e-18) return false;
+    double a_c = ( b0*S11 - S01*b1) / det;
+    double b   = (-b0*S01 + S00*b1) / det;
+    y_t  = a_c + b*(t - xm);
+    slope = b;
+    return true;
+}
+
+static inline double tail_median(const vector<double>& d, int W){
+    if(d.empty()) return 1.0;
+    int n = (int)d.size();
+    int m = max(1, min(W, n));
+    vector<double> w(d.end()-m, d.end());
+    nth_element(w.begin(), w.begin()+m/2, w.end());
+    if(m%2==1) return w[m/2];
+    nth_element(w.begin(), w.begin()+m/2-1, w.end());
+    return 0.5*(w[m/2] + w[m/2-1]);
+}
+
+/* ---------------- Etapas (usadas por get_nowcast y pipeline) ---------------- */
+// Series de TRADE por instrumento, ordenadas por tiempo y sin timestamps duplicados.
+// Row: cualquier fila con instrument, side, ts_sec, vwap (DFRow o MetricRow).
+template<class Row>
+static inline unordered_map<string, vector<TP>> build_trade_map(const vector<Row>& rows){
+    TRACE_SCOPE("dedupe");
+    unordered_map<string, vector<TP>> trade_map;
+    for(const auto& r: rows){
+        if(r.side!="TRADE") continue;
+        if(!isfinite(r.vwap)) continue;
+        trade_map[r.instrument].push_back({r.ts_sec, r.vwap});
+    }
+    for(auto& kv: trade_map){
+        auto& v = kv.second;
+        sort(v.begin(), v.end(), [](const TP& a, const TP& b){ return a.t < b.t; });
+        vector<TP> u; u.reserve(v.size());
+        for(const auto& p: v){
+            if(!u.empty() && fabs(u.back().t - p.t) < 1e-9) u.back() = p;
+            else u.push_back(p);
+        }
+        v.swap(u);
+    }
+    return trade_map;
+}
+
+// Features de book por trade (columnas de process_market --book), en el orden de xy_train.csv.
+static const int N_BOOK = 4;
+static const char* BOOK_FEATS[N_BOOK] = {"mid", "micro", "qspread", "imb"};
+struct BookTP { double t; double f[N_BOOK]; };
+
+// Como build_trade_map pero arma ademas la serie de book as-of de cada instrumento con todas las filas
+// que traen book (BI, OF y TRADE de process_market --book), asi en t0 se usa el ultimo quote y no el
+// del ultimo trade. Con un df_all que solo trae book en los TRADE queda la serie de los trades.
+// Filas con el mismo t tienen el mismo book as-of; se queda la ultima.
+static inline void build_trade_book_maps(const vector<DFRow>& rows,
+                                         unordered_map<string, vector<TP>>& trade_map,
+                                         unordered_map<string, vector<BookTP>>& book_map){
+    trade_map = build_trade_map(rows);
+    TRACE_SCOPE("dedupe");
+    for(const auto& r: rows){
+        if(!isfinite(r.mid)) continue;
+        book_map[r.instrument].push_back({r.ts_sec, {r.mid, r.microprice, r.quote_spread, r.imbalance}});
+    }
+    for(auto& kv: book_map){
+        auto& v = kv.second;
+        stable_sort(v.begin(), v.end(), [](const BookTP& a, const BookTP& b){ return a.t < b.t; });
+        vector<BookTP> u; u.reserve(v.size());
+        for(const auto& b: v){
+            if(!u.empty() && fabs(u.back().t - b.t) < 1e-9) u.back() = b;
+            else u.push_back(b);
+        }
+        v.swap(u);
+    }
+}
+
+// target primero y luego los top_others instrumentos con mas trades; empates por nombre, asi la
+// seleccion no depende del orden de iteracion del unordered_map (cache vs df_all). Con book_map
+// solo entran instrumentos con book (uno sin bid/ask descartaria todas las filas).
+static inline vector<string> select_instruments(const unordered_map<string, vector<TP>>& trade_map,
+                                                const string& target, int top_others,
+                                                const unordered_map<string, vector<BookTP>>* book_map = nullptr){
+    vector<pair<string,int>> counts;
+    counts.reserve(trade_map.size());
+    for(auto& kv: trade_map){
+        if(book_map && !book_map->count(kv.first)) continue;
+        counts.push_back({kv.first, (int)kv.second.size()});
+    }
+    sort(counts.begin(), counts.end(), [](auto& a, auto& b){
+        return a.second!=b.second? a.second>b.second : a.first<b.first;
+    });
+
+    vector<string> selected; selected.push_back(target);
+    for(auto& pr: counts){
+        if((int)selected.size()>=1+top_others) break;
+        if(pr.first==target) continue;
+        selected.push_back(pr.first);
+    }
+    return selected;
+}
+
+struct XYRow {
+    double t0, t1;
+    vector<double> p;
+    vector<double> m;
+    vector<double> book;   // N_BOOK*K (feature-major) si se agregaron features de book
+    double m_next, dt_next, p_now;
+};
+
+// Ajustes de s en cada tiempo del target: p[j], m[j] = recta de k_last puntos evaluada en tar[j].t.
+// NaN donde no hay ajuste (menos de k_last puntos hasta ese t o det ~ 0).
+struct FitColumn { vector<double> p, m; };
+struct FitColumnView { const double* p; const double* m; };   // columna propia o mapeada del cache
+
+static inline FitColumn fit_column(const vector<TP>& s, const vector<TP>& tar, int k_last){
+    FitColumn c;
+    c.p.assign(tar.size(), NaN);
+    c.m.assign(tar.size(), NaN);
+    for(size_t j=0;j<tar.size();++j){
+        double p, m;
+        if(fit_line_lastk_at_t(s, tar[j].t, k_last, p, m)){ c.p[j] = p; c.m[j] = m; }
+    }
+    return c;
+}
+
+// Arma las filas a partir de las columnas de ajuste (cols[j] corresponde a selected[j], cols[0] al target).
+static inline vector<XYRow> build_xy_rows_from_columns(const vector<TP>& tar, const vector<FitColumnView>& cols,
+                                                       int k_last){
+    vector<XYRow> valid_rows; valid_rows.reserve(tar.size());
+    long long n_failed = 0;
+    for(int i=k_last-1; i<(int)tar.size()-1; ++i){
+        XYRow row; row.t0=tar[i].t; row.t1=tar[i+1].t; row.p.resize(cols.size()); row.m.resize(cols.size());
+        bool ok=true;
+        for(size_t j=0;j<cols.size();++j){
+            if(isnan(cols[j].m[i])){ ok=false; break; }
+            row.p[j] = j==0? tar[i].v : cols[j].p[i];   // el target usa su precio observado
+            row.m[j] = cols[j].m[i];
+        }
+        // label: pendiente del target en el trade siguiente
+        if(!ok || isnan(cols[0].m[i+1])){ ++n_failed; continue; }
+        row.m_next = cols[0].m[i+1];
+        row.dt_next = row.t1 - row.t0;
+        row.p_now = row.p[0];
+        valid_rows.push_back(move(row));
+    }
+    TRACE_COUNTER("fits_failed", n_failed);
+    return valid_rows;
+}
+
+// Para cada t0 del target: p/m de cada instrumento seleccionado con rectas de k_last puntos,
+// label m_next = pendiente del target en el trade siguiente. selected[0] es el target.
+static inline vector<XYRow> build_xy_rows(const unordered_map<string, vector<TP>>& trade_map,
+                                          const vector<string>& selected, int k_last){
+    TRACE_SCOPE("fit");
+    const auto& tar = trade_map.at(selected[0]);
+    vector<FitColumn> cols;
+    vector<FitColumnView> views;
+    cols.reserve(selected.size());
+    for(const auto& inst: selected){
+        cols.push_back(fit_column(trade_map.at(inst), tar, k_last));
+        views.push_back({cols.back().p.data(), cols.back().m.data()});
+    }
+    return build_xy_rows_from_columns(tar, views, k_last);
+}
+
+// Agrega a cada fila el book as-of de cada instrumento seleccionado en t0 (ultima fila con book y t <= t0),
+// con un cursor por instrumento que solo avanza (las filas estan ordenadas por t0). Descarta las filas
+// donde algun instrumento todavia no tiene bid y ask; devuelve cuantas.
+static inline long long add_book_features(vector<XYRow>& rows, const vector<string>& selected,
+                                          const unordered_map<string, vector<BookTP>>& book_map){
+    TRACE_SCOPE("book");
+    const int K = (int)selected.size();
+    for(auto& r: rows) r.book.assign((size_t)N_BOOK*K, NaN);
+    for(int j=0;j<K;++j){
+        const auto& s = book_map.at(selected[j]);
+        size_t c = 0;
+        for(auto& r: rows){
+            while(c < s.size() && s[c].t <= r.t0) ++c;
+            if(c==0) continue;
+            for(int f=0;f<N_BOOK;++f) r.book[(size_t)f*K + j] = s[c-1].f[f];
+        }
+    }
+    const size_t n0 = rows.size();
+    rows.erase(remove_if(rows.begin(), rows.end(), [](const XYRow& r){
+        return any_of(r.book.begin(), r.book.end(), [](double v){ return !isfinite(v); });
+    }), rows.end());
+    return (long long)(n0 - rows.size());
+}
+
+// X = [p__..., m__..., (mid__..., micro__..., qspread__..., imb__...)] en el orden de selected
+// (lo que espera el bundle)
+static inline void xy_row_features(const XYRow& r, double* x){
+    const int K = (int)r.p.size();
+    for(int j=0;j<K;j++) x[j]   = r.p[j];
+    for(int j=0;j<K;j++) x[K+j] = r.m[j];
+    for(size_t i=0;i<r.book.size();i++) x[2*K+i] = r.book[i];
+}
+
+static inline bool write_xy_csv(const string& path, const vector<string>& selected, const vector<XYRow>& rows){
+    TRACE_SCOPE("write");
+    ofstream fout(path);
+    if(!fout) return false;
+    const int K = (int)selected.size();
+    for(int j=0;j<K;j++){
+        if(j) fout<<",";
+        fout<<"p__"<<selected[j];
+    }
+    for(int j=0;j<K;j++){
+        fout<<","<<"m__"<<selected[j];
+    }
+    const bool book = !rows.empty() && !rows[0].book.empty();
+    if(book)
+        for(int f=0;f<N_BOOK;f++)
+            for(int j=0;j<K;j++) fout<<","<<BOOK_FEATS[f]<<"__"<<selected[j];
+    fout<<",y\n";
+    const int d = 2*K + (book? N_BOOK*K : 0);
+    vector<double> xrow(d);
+    for(const auto& r: rows){
+        xy_row_features(r, xrow.data());
+        for(int i=0;i<d;i++){
+            if(i) fout<<",";
+            fout<<setprecision(12)<<fixed<<xrow[i];
+        }
+        fout<<","<<setprecision(12)<<fixed<<r.m_next<<"\n";
+    }
+    return (bool)fout;
+}
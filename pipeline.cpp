@@ -0,0 +1,138 @@
+// pipeline.cpp — market_data/ -> VWAP -> features -> MLP en un solo proceso, sin CSV intermedios.
+// Encadena las etapas de process_market (market_core), get_nowcast (nowcast_core) y
+// mlp_infer_plain (mlp_core) en memoria; df_all.csv / xy_train.csv solo se escriben si se piden.
+#include <bits/stdc++.h>
+#include "market_core.hpp"
+#include "nowcast_core.hpp"
+#include "mlp_core.hpp"
+using namespace std;
+
+int main(int argc, char** argv){
+    string dir = "./market_data";
+    string target;
+    int k_last = 3;
+    int top_others = 4;
+    string bundle_path = "mlp_bundle.txt";
+    string df_out, xy_out, pred_out;
+    ActImpl act = ActImpl::Libm;
+
+    for(int i=1;i<argc;i++){
+        string a = argv[i];
+        auto need=[&](const char* name){ if(i+1>=argc){ cerr<<"Falta valor para "<<name<<"\n"; exit(1);} return string(argv[++i]); };
+        if(a=="--dir") dir = need("--dir");
+        else if(a=="--target") target = need("--target");
+        else if(a=="--k_last") k_last = stoi(need("--k_last"));
+        else if(a=="--top_others") top_others = stoi(need("--top_others"));
+        else if(a=="--bundle") bundle_path = need("--bundle");
+        else if(a=="--df_out") df_out = need("--df_out");
+        else if(a=="--xy_out") xy_out = need("--xy_out");
+        else if(a=="--pred_out") pred_out = need("--pred_out");
+        else if(a=="--act"){
+            string v = need("--act");
+            if(v=="libm") act = ActImpl::Libm;
+            else if(v=="fast") act = ActImpl::Fast;
+            else { cerr<<"--act debe ser libm|fast\n"; return 1; }
+        }
+        else { cerr<<"Arg desconocido: "<<a<<"\n"; return 1; }
+    }
+    if(target.empty()){
+        cerr<<"Debes pasar --target <instrumento>\n";
+        return 1;
+    }
+
+    vector<pair<string,double>> stages;
+    auto t_prev = chrono::steady_clock::now();
+    auto lap = [&](const string& name){
+        auto t = chrono::steady_clock::now();
+        stages.push_back({name, chrono::duration<double, milli>(t - t_prev).count()});
+        t_prev = t;
+    };
+
+    Bundle B;
+    try { B = load_bundle_txt(bundle_path); }
+    catch(const exception& ex){ cerr<<ex.what()<<"\n"; return 1; }
+    lap("load_bundle");
+
+    // 1) ticks
+    vector<string> files;
+    string err;
+    if(!list_market_files(dir, files, err)){ cerr<<err<<"\n"; return 1; }
+    unordered_map<string, vector<RawRow>> dfs;
+    load_market_files(files, dfs);
+    if(dfs.empty()){ cerr<<"No se pudieron leer filas válidas.\n"; return 1; }
+    size_t n_ticks = 0; for(const auto& kv: dfs) n_ticks += kv.second.size();
+    lap("read_ticks");
+
+    // 2) agrupado + VWAP/spread
+    vector<MetricRow> df_all;
+    vector<string> eligible;
+    build_metrics_all(dfs, df_all, eligible);
+    dfs.clear();
+    if(df_all.empty()){ cerr<<"df_all vacío (no hubo métricas).\n"; return 1; }
+    lap("group_metrics");
+    if(!df_out.empty()){
+        if(!write_df_all(df_out, df_all)){ cerr<<"No se pudo escribir "<<df_out<<"\n"; return 1; }
+        lap("write_df_all");
+    }
+
+    // 3) features
+    auto trade_map = build_trade_map(df_all);
+    if(!trade_map.count(target)){
+        cerr<<"Target instrument not found in df_all: "<<target<<"\n";
+        return 1;
+    }
+    if((int)trade_map[target].size() < max(k_last, 2)){
+        cerr<<"Muy pocos puntos del target.\n";
+        return 1;
+    }
+    vector<string> selected = select_instruments(trade_map, target, top_others);
+    vector<XYRow> xy = build_xy_rows(trade_map, selected, k_last);
+    if(xy.empty()){ cerr<<"No se generaron muestras válidas.\n"; return 1; }
+    lap("features");
+    if(!xy_out.empty()){
+        if(!write_xy_csv(xy_out, selected, xy)){ cerr<<"No se pudo escribir "<<xy_out<<"\n"; return 1; }
+        lap("write_xy");
+    }
+
+    // 4) forward MLP
+    const int n = (int)xy.size(), d = 2*(int)selected.size();
+    if(d != B.n_features){
+        cerr<<"[ERROR] features="<<d<<" != n_features del modelo "<<B.n_features<<"\n";
+        return 1;
+    }
+    vector<double> X((size_t)n*d), y(n);
+    for(int i=0;i<n;++i){ xy_row_features(xy[i], &X[(size_t)i*d]); y[i] = xy[i].m_next; }
+    auto yhat = mlp_predict(B, X, n, act);
+    lap("inference");
+    auto [mse, r2] = mse_r2(y, yhat);
+
+    if(!pred_out.empty()){
+        ofstream fout(pred_out);
+        if(!fout){ cerr<<"No se pudo abrir "<<pred_out<<"\n"; return 1; }
+        fout.setf(std::ios::fixed); fout<<setprecision(10);
+        fout<<"t0,y,yhat\n";
+        for(int i=0;i<n;++i) fout<<xy[i].t0<<","<<y[i]<<","<<yhat[i]<<"\n";
+        lap("write_preds");
+    }
+
+    double total = 0.0; for(auto& s: stages) total += s.second;
+    cout.setf(std::ios::fixed); cout<<setprecision(10);
+    cout<<"{\n";
+    cout<<"  \"selected_instruments\": [";
+    for(size_t i=0;i<selected.size();i++){ if(i) cout<<", "; cout<<"\""<<selected[i]<<"\""; }
+    cout<<"],\n";
+    cout<<"  \"n_ticks\": "<<n_ticks<<",\n";
+    cout<<"  \"n_groups\": "<<df_all.size()<<",\n";
+    cout<<"  \"n_samples\": "<<n<<",\n";
+    cout<<"  \"mse\": "<<mse<<",\n";
+    cout<<"  \"r2\": "<<r2<<",\n";
+    cout<<"  \"last_t0\": "<<xy.back().t0<<",\n";
+    cout<<"  \"last_yhat\": "<<yhat.back()<<",\n";
+    cout<<setprecision(3);
+    cout<<"  \"stage_ms\": {";
+    for(size_t i=0;i<stages.size();++i){ if(i) cout<<", "; cout<<"\""<<stages[i].first<<"\": "<<stages[i].second; }
+    cout<<"},\n";
+    cout<<"  \"total_ms\": "<<total<<"\n";
+    cout<<"}\n";
+    return 0;
+}
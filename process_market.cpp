@@ -1,307 +1,292 @@
 // process_market.cpp
 #include <bits/stdc++.h>
 #include <filesystem>
+#include "market_core.hpp"
+#include "manifest.hpp"
 using namespace std;
 namespace fs = std::filesystem;
 
-static const double NaN = std::numeric_limits<double>::quiet_NaN();
-
-/* ---------------- CSV utils ---------------- */
-vector<string> split_csv(const string& s, char delim=',') {
-    vector<string> out; out.reserve(16);
-    string cur; cur.reserve(s.size());
-    bool in_quotes = false;
-    for (char c : s) {
-        if (c == '"') { in_quotes = !in_quotes; continue; }
-        if (!in_quotes && c == delim) { out.push_back(cur); cur.clear(); }
-        else cur.push_back(c);
-    }
-    out.push_back(cur);
-    return out;
-}
-static inline string trim(const string& s) {
-    size_t a = s.find_first_not_of(" \t\r\n");
-    if (a == string::npos) return "";
-    size_t b = s.find_last_not_of(" \t\r\n");
-    return s.substr(a, b - a + 1);
-}
-static inline bool to_double(const string& s, double& x) {
-    string t = trim(s);
-    if (t.empty()) { x = NaN; return false; }
-    try { x = stod(t); return true; }
-    catch(...) { x = NaN; return false; }
-}
-static inline bool to_int64(const string& s, long long& x) {
-    string t = trim(s);
-    if (t.empty()) { x = 0; return false; }
-    try { x = stoll(t); return true; }
-    catch(...) { x = 0; return false; }
-}
-
-/* ---------------- Data structs ---------------- */
-struct RawRow {
-    long long fecha_nano; // ns epoch
-    double price;
-    double quantity;
-    string side;
-};
-
-struct GroupRow {
-    long long fecha_nano;
-    string side;
-    vector<double> prices;
-    vector<double> quantities;
+/* ---------------- Modo particionado (--root) ---------------- */
+// root/<fecha>/*.csv|*.tka -> out_dir/<fecha>/df_all.csv + out_dir/manifest.csv
+struct PartitionOpts {
+    string root;
+    string out_dir = "./df_parts";
+    int jobs = 0;                 // 0 -> hardware_concurrency
+    long long mem_budget_mb = 4096;
+    bool force = false;
+    bool book = false;            // columnas de book as-of en cada fila
 };
 
-struct MetricRow {
-    string instrument;
-    string side;
-    long long fecha_nano;
-    double ts_sec;   // fecha_nano / 1e9
-    double vwap;
-    double spread;   // sqrt(var_ponderada)
+struct PartitionJob {
+    string date;
+    vector<string> files;
+    string sig;
+    long long est_bytes = 0;
 };
 
-/* ---------------- IO ---------------- */
-bool read_csv_minimal(const string& path,
-                      vector<RawRow>& out_rows) {
-    ifstream fin(path);
-    if (!fin) return false;
-
-    string header;
-    if (!getline(fin, header)) return false;
+// firma de la particion: nombre, tamaño y mtime de cada archivo fuente (+ si lleva columnas de book)
+static string source_signature(const vector<string>& files, bool book){
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto mix = [&](const string& s){ for(unsigned char c: s) h = (h ^ c) * 0x100000001b3ULL; h = (h ^ 0xff) * 0x100000001b3ULL; };
+    vector<string> sorted = files;
+    sort(sorted.begin(), sorted.end());
+    for(const auto& f: sorted){
+        mix(fs::path(f).filename().string());
+        mix(to_string(fs::file_size(f)));
+        mix(to_string(fs::last_write_time(f).time_since_epoch().count()));
+    }
+    if(book) mix("book:quotes");   // book tambien en BI/OF: reprocesa particiones hechas antes con --book
+    char buf[17]; snprintf(buf, sizeof buf, "%016llx", (unsigned long long)h);
+    return buf;
+}
 
-    auto cols = split_csv(header);
-    for (auto& c : cols) c = trim(c);
+// Estimacion gruesa de memoria pico: RawRow + grupos + metricas por fila de entrada
+// (~4x el tamaño del CSV, ~30x el del .tka que ocupa ~6 bytes por fila).
+static long long estimate_bytes(const vector<string>& files){
+    long long b = 0;
+    for(const auto& f: files) b += (long long)fs::file_size(f) * (fs::path(f).extension()==".tka"? 30 : 4);
+    return b;
+}
 
-    // map columnas -> índice
-    int idx_fecha = -1, idx_price = -1, idx_qty = -1, idx_side = -1;
-    for (int i=0;i<(int)cols.size();++i) {
-        if (cols[i] == "fecha_nano") idx_fecha = i;
-        else if (cols[i] == "price") idx_price = i;
-        else if (cols[i] == "quantity") idx_qty = i;
-        else if (cols[i] == "side") idx_side = i;
+// Semaforo de memoria: una particion espera hasta que su estimacion entre en el presupuesto;
+// si sola ya lo excede corre cuando no hay otra en curso.
+class MemBudget {
+public:
+    explicit MemBudget(long long cap): cap_(cap) {}
+    void acquire(long long n){
+        unique_lock<mutex> lk(mu_);
+        cv_.wait(lk, [&]{ return used_==0 || used_ + n <= cap_; });
+        used_ += n;
     }
-    if (idx_fecha<0 || idx_price<0 || idx_qty<0 || idx_side<0) {
-        cerr << "Faltan columnas en: " << path << "\n";
-        return false;
+    void release(long long n){
+        { lock_guard<mutex> lk(mu_); used_ -= n; }
+        cv_.notify_all();
     }
+private:
+    mutex mu_;
+    condition_variable cv_;
+    long long cap_, used_ = 0;
+};
 
-    string line;
-    while (getline(fin, line)) {
-        if (trim(line).empty()) continue;
-        auto t = split_csv(line);
-        if ((int)t.size() <= max({idx_fecha, idx_price, idx_qty, idx_side}))
-            t.resize(max({idx_fecha, idx_price, idx_qty, idx_side})+1);
-
-        long long f; double p, q;
-        bool okf = to_int64(t[idx_fecha], f);
-        bool okp = to_double(t[idx_price], p);
-        bool okq = to_double(t[idx_qty], q);
-        string s = trim(t[idx_side]);
-
-        // Simula dropna de Python en (price, quantity, side)
-        if (!okf || !okp || !okq || !isfinite(p) || !isfinite(q) || s.empty())
-            continue;
+// Procesa una particion: df_all ordenado por (instrument, side, fecha_nano) y una entrada de
+// manifest por rango contiguo (instrument, side). Sin filas queda una sola entrada con instrument y
+// side vacios que solo registra la firma, para no reprocesarla en cada corrida.
+static bool process_partition(const PartitionJob& job, const fs::path& out_dir, bool book,
+                              vector<ManifestEntry>& entries, size_t& n_rows){
+    TRACE_SCOPE("partition");
+    unordered_map<string, vector<RawRow>> dfs;
+    load_market_files(job.files, dfs);
+    vector<MetricRow> df_all;
+    vector<string> eligible;
+    build_metrics_all(dfs, df_all, eligible);
+    dfs.clear();
+    stable_sort(df_all.begin(), df_all.end(), [](const MetricRow& a, const MetricRow& b){
+        if (a.instrument!=b.instrument) return a.instrument<b.instrument;
+        if (a.side!=b.side) return a.side<b.side;
+        return a.fecha_nano<b.fecha_nano;
+    });
+    n_rows = df_all.size();
+    vector<BookFeat> bk;
+    if (book) bk = build_book_features(df_all);
 
-        out_rows.push_back({f, p, q, s});
+    const string rel = job.date + "/df_all.csv";
+    fs::create_directories(out_dir / job.date);
+    const fs::path path = out_dir / rel, tmp = out_dir / (rel + ".tmp");
+    {
+        TRACE_SCOPE("write");
+        ofstream fout(tmp);
+        if (!fout) return false;
+        write_df_header(fout, book);
+        fout.setf(std::ios::fixed); fout<<setprecision(10);
+        size_t i = 0;
+        while (i < df_all.size()) {
+            ManifestEntry e;
+            e.date = job.date; e.instrument = df_all[i].instrument; e.side = df_all[i].side; e.file = rel;
+            e.row_begin = (long long)i; e.byte_begin = (long long)fout.tellp();
+            e.min_ts = e.max_ts = df_all[i].fecha_nano;
+            for (; i<df_all.size() && df_all[i].instrument==e.instrument && df_all[i].side==e.side; ++i) {
+                write_df_row(fout, df_all[i], book? &bk[i] : nullptr);
+                e.max_ts = df_all[i].fecha_nano;   // ordenado por fecha dentro del rango
+            }
+            e.row_end = (long long)i; e.byte_end = (long long)fout.tellp();
+            e.source_sig = job.sig;
+            entries.push_back(move(e));
+        }
+        if (df_all.empty()) {
+            ManifestEntry e;
+            e.date = job.date; e.file = rel; e.source_sig = job.sig;
+            e.byte_begin = e.byte_end = (long long)fout.tellp();
+            entries.push_back(move(e));
+        }
+        if (!fout) return false;
     }
+    fs::rename(tmp, path);
     return true;
 }
 
-/* ---------------- Core: build_df_for_side ---------------- */
-vector<GroupRow> build_df_for_side(const vector<RawRow>& rows, const string& curr_side) {
-    // filtra por side
-    vector<RawRow> v;
-    v.reserve(rows.size());
-    for (const auto& r : rows) if (r.side == curr_side) v.push_back(r);
-    if (v.empty()) return {};
-
-    // orden estable por fecha_nano
-    stable_sort(v.begin(), v.end(), [](const RawRow& a, const RawRow& b){
-        return a.fecha_nano < b.fecha_nano;
-    });
+// YYYY-MM-DD: ordena como fecha al comparar strings y no necesita escaparse en el CSV
+static bool is_partition_date(const string& s){
+    if (s.size()!=10 || s[4]!='-' || s[7]!='-') return false;
+    for (int i : {0,1,2,3,5,6,8,9}) if (!isdigit((unsigned char)s[i])) return false;
+    return true;
+}
 
-    // agrupa por fecha_nano
-    vector<GroupRow> out;
-    size_t i=0, n=v.size();
-    while (i<n) {
-        long long key = v[i].fecha_nano;
-        size_t j=i;
-        vector<double> ps, qs;
-        while (j<n && v[j].fecha_nano==key) {
-            double p=v[j].price, q=v[j].quantity;
-            if (isfinite(p) && isfinite(q) && p>0.0 && q>0.0) {
-                ps.push_back(p);
-                qs.push_back(q);
+static int run_partitioned(const PartitionOpts& opt){
+    // particiones: subdirectorios de root con al menos un .csv/.tka
+    vector<PartitionJob> parts;
+    try {
+        for (const auto& e : fs::directory_iterator(opt.root)) {
+            if (!e.is_directory()) continue;
+            PartitionJob job;
+            job.date = e.path().filename().string();
+            if (!is_partition_date(job.date)) {   // va sin escapar al manifest y se compara con --from/--to
+                log_err("[WARN] se ignora " + e.path().string() + ": el nombre no es una fecha YYYY-MM-DD");
+                continue;
             }
-            ++j;
+            string err;
+            if (!list_market_files(e.path().string(), job.files, err)) continue;
+            job.sig = source_signature(job.files, opt.book);
+            job.est_bytes = estimate_bytes(job.files);
+            parts.push_back(move(job));
         }
-        out.push_back({key, curr_side, move(ps), move(qs)});
-        i=j;
+    } catch (const std::exception& ex) {
+        cerr << "Error leyendo " << opt.root << ": " << ex.what() << "\n";
+        return 1;
     }
-    return out;
-}
+    if (parts.empty()) { cerr << "No hay particiones con CSVs en " << opt.root << "\n"; return 1; }
+    sort(parts.begin(), parts.end(), [](const PartitionJob& a, const PartitionJob& b){ return a.date < b.date; });
 
-/* ---------------- VWAP & spread ---------------- */
-inline MetricRow make_metric(const string& instrument, const GroupRow& g) {
-    double vwap = NaN, spread = NaN;
-    const auto& P = g.prices;
-    const auto& W = g.quantities;
+    const fs::path out_dir = opt.out_dir;
+    fs::create_directories(out_dir);
+    const string manifest_path = (out_dir / "manifest.csv").string();
 
-    if (!P.empty() && P.size()==W.size()) {
-        double sumw = 0.0, sumpw = 0.0;
-        for (size_t i=0;i<P.size();++i) {
-            double w=W[i], p=P[i];
-            if (isfinite(w) && isfinite(p) && w>0.0) { sumw += w; sumpw += w*p; }
-        }
-        if (sumw > 0.0) {
-            vwap = sumpw / sumw;
-            double varw = 0.0;
-            for (size_t i=0;i<P.size();++i) {
-                double w=W[i], p=P[i];
-                if (isfinite(w) && isfinite(p) && w>0.0) {
-                    double d = p - vwap;
-                    varw += w * d * d;
-                }
-            }
-            varw /= sumw;
-            spread = std::sqrt(varw);
+    // entradas vigentes por fecha; una particion esta al dia si su firma no cambio y el df_all existe.
+    // Las de particiones a reprocesar se conservan hasta que haya reemplazo: si falla quedan las viejas
+    // (su df_all no se toco) y la proxima corrida la reintenta porque la firma no coincide.
+    map<string, vector<ManifestEntry>> by_date;
+    {
+        vector<ManifestEntry> old;
+        if (fs::exists(manifest_path) && !read_manifest(manifest_path, old))
+            cerr << "[WARN] manifest ilegible, se regenera\n";
+        for (auto& e : old) by_date[e.date].push_back(move(e));
+    }
+    vector<const PartitionJob*> todo;
+    int skipped = 0;
+    {
+        map<string, vector<ManifestEntry>> keep;
+        for (const auto& p : parts) {
+            auto it = by_date.find(p.date);
+            const bool current = it!=by_date.end() && !it->second.empty() && it->second[0].source_sig==p.sig
+                                 && fs::exists(out_dir / it->second[0].file);
+            if (!opt.force && current) ++skipped;
+            else todo.push_back(&p);
+            if (it!=by_date.end()) keep[p.date] = move(it->second);
         }
+        by_date.swap(keep);   // se descartan fechas que ya no existen en root
     }
-    double ts_sec = static_cast<double>(g.fecha_nano) / 1e9;
-    return {instrument, g.side, g.fecha_nano, ts_sec, vwap, spread};
+
+    mutex mu;   // by_date + manifest
+    auto flush_manifest = [&]{
+        vector<ManifestEntry> all;
+        for (const auto& kv : by_date) all.insert(all.end(), kv.second.begin(), kv.second.end());
+        return write_manifest(manifest_path, all);
+    };
+    if (todo.empty()) {
+        lock_guard<mutex> lk(mu);
+        if (!flush_manifest()) { cerr << "No se pudo escribir " << manifest_path << "\n"; return 1; }
+    }
+
+    MemBudget budget(opt.mem_budget_mb << 20);
+    atomic<size_t> next{0};
+    atomic<int> failed{0};
+    auto worker = [&]{
+        for (size_t k; (k = next.fetch_add(1)) < todo.size(); ) {
+            const PartitionJob& job = *todo[k];
+            auto tw = chrono::steady_clock::now();
+            budget.acquire(job.est_bytes);
+            auto t0 = chrono::steady_clock::now();   // el tiempo de proceso no incluye la espera de memoria
+            double wait_ms = chrono::duration<double, milli>(t0 - tw).count();
+            vector<ManifestEntry> entries;
+            size_t n_rows = 0;
+            bool ok = false;
+            try { ok = process_partition(job, out_dir, opt.book, entries, n_rows); }
+            catch (const std::exception& ex) { log_err("[" + job.date + "] " + ex.what()); }
+            budget.release(job.est_bytes);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+            if (!ok) { ++failed; log_err("[" + job.date + "] error escribiendo " + (out_dir / job.date).string()); continue; }
+            lock_guard<mutex> lk(mu);
+            by_date[job.date] = move(entries);
+            if (!flush_manifest()) { ++failed; log_err("No se pudo escribir " + manifest_path); continue; }
+            char buf[96]; snprintf(buf, sizeof buf, "rows=%zu (%.1f ms, espera de memoria %.1f ms)", n_rows, ms, wait_ms);
+            log_err("[" + job.date + "] " + buf);
+        }
+    };
+    int jobs = opt.jobs>0? opt.jobs : (int)max(1u, thread::hardware_concurrency());
+    jobs = min<int>(jobs, (int)max<size_t>(todo.size(), 1));
+    vector<thread> pool;
+    for (int i=0;i<jobs;++i) pool.emplace_back(worker);
+    for (auto& t : pool) t.join();
+
+    cerr << "Manifest escrito en: " << manifest_path << " (particiones procesadas=" << todo.size()
+         << " al dia=" << skipped << " errores=" << failed.load() << ")\n";
+    return failed? 1 : 0;
 }
 
 /* ---------------- Main ---------------- */
 int main(int argc, char** argv) {
     string dir = "./market_data";
-    if (argc>1) {
-        string a = argv[1];
-        if (a=="--dir" && argc>=3) dir = argv[2];
+    PartitionOpts popt;
+    for (int i=1;i<argc;i++) {
+        string a = argv[i];
+        auto need=[&](const char* name){ if(i+1>=argc){ cerr<<"Falta valor para "<<name<<"\n"; exit(1);} return string(argv[++i]); };
+        if (a=="--dir") dir = need("--dir");
+        else if (a=="--root") popt.root = need("--root");
+        else if (a=="--out_dir") popt.out_dir = need("--out_dir");
+        else if (a=="--jobs") popt.jobs = stoi(need("--jobs"));
+        else if (a=="--mem_budget_mb") popt.mem_budget_mb = stoll(need("--mem_budget_mb"));
+        else if (a=="--force") popt.force = true;
+        else if (a=="--book") popt.book = true;
+        else { cerr<<"Arg desconocido: "<<a<<"\n"; return 1; }
     }
+    if (!popt.root.empty()) return run_partitioned(popt);
 
     // 1) Listar CSVs
     vector<string> csv_files;
-    try {
-        for (const auto& e : fs::directory_iterator(dir)) {
-            if (e.is_regular_file()) {
-                auto p = e.path();
-                if (p.extension()==".csv") csv_files.push_back(p.string());
-            }
-        }
-    } catch (const std::exception& ex) {
-        cerr << "Error leyendo el directorio: " << ex.what() << "\n";
-        return 1;
-    }
-    if (csv_files.empty()) {
-        cerr << "No hay CSVs en " << dir << "\n";
+    string err;
+    if (!list_market_files(dir, csv_files, err)) {
+        cerr << err << "\n";
         return 1;
     }
 
     // 2) Leer todos los CSVs
     //    dfs: instrumento (nombre de archivo sin .csv) -> vector<RawRow>
     unordered_map<string, vector<RawRow>> dfs;
-    for (const auto& path : csv_files) {
-        string stem = fs::path(path).stem().string(); // nombre sin .csv
-        vector<RawRow> rows;
-        if (!read_csv_minimal(path, rows)) {
-            cerr << "Saltando (no legible): " << path << "\n";
-            continue;
-        }
-        if (!rows.empty()) dfs.emplace(stem, move(rows));
-    }
+    load_market_files(csv_files, dfs);
     if (dfs.empty()) {
         cerr << "No se pudieron leer filas válidas.\n";
         return 1;
     }
 
-    // 3) Para cada instrumento, detectar sides presentes
-    vector<MetricRow> df_all; df_all.reserve(1<<20);
-    // all_series[instrument][side]["vwap"/"spread"][fecha_nano] = valor
-    struct SeriesPair { map<long long,double> vwap, spread; };
-    unordered_map<string, unordered_map<string, SeriesPair>> all_series;
-
-    for (auto& kv : dfs) {
-        const string& inst = kv.first;
-        const auto& rows = kv.second;
-
-        // sides presentes
-        unordered_set<string> sides_present;
-        for (const auto& r : rows) sides_present.insert(r.side);
-
-        // build_df_for_side -> group rows por timestamp
-        vector<GroupRow> all_groups;
-        for (const string& s : sides_present) {
-            auto g = build_df_for_side(rows, s);
-            all_groups.insert(all_groups.end(), make_move_iterator(g.begin()), make_move_iterator(g.end()));
-        }
-        if (all_groups.empty()) continue;
-
-        // build_metrics
-        // ordenamos por fecha para coherencia
-        sort(all_groups.begin(), all_groups.end(),
-             [](const GroupRow& a, const GroupRow& b){
-                 if (a.fecha_nano!=b.fecha_nano) return a.fecha_nano<b.fecha_nano;
-                 return a.side < b.side;
-             });
-
-        // Por side, acumulamos series
-        unordered_map<string, SeriesPair> series_by_side;
-
-        for (const auto& g : all_groups) {
-            MetricRow mr = make_metric(inst, g);
-            df_all.push_back(mr);
-
-            // solo cargamos series si vwap/spread no son NaN
-            auto& sp = series_by_side[g.side];
-            if (isfinite(mr.vwap))   sp.vwap[g.fecha_nano]   = mr.vwap;
-            if (isfinite(mr.spread)) sp.spread[g.fecha_nano] = mr.spread;
-        }
-        all_series[inst] = move(series_by_side);
-    }
+    // 3) Agrupar y calcular métricas; elegibles: requieren BI, OF, TRADE con vwap válido
+    vector<MetricRow> df_all;
+    vector<string> eligible;
+    build_metrics_all(dfs, df_all, eligible);
 
     if (df_all.empty()) {
         cerr << "df_all vacío (no hubo métricas).\n";
         return 1;
     }
 
-    // 4) Escribir df_all.csv
-    {
-        ofstream fout("df_all.csv");
-        fout << "instrument,side,fecha_nano,ts_sec,vwap,spread\n";
-        fout.setf(std::ios::fixed); fout<<setprecision(10);
-        for (const auto& r : df_all) {
-            fout << r.instrument << "," << r.side << ","
-                 << r.fecha_nano << "," << r.ts_sec << ",";
-            if (isfinite(r.vwap)) fout << r.vwap; else fout << "";
-            fout << ",";
-            if (isfinite(r.spread)) fout << r.spread; else fout << "";
-            fout << "\n";
-        }
-    }
-
-    // 5) Elegibles: requieren BI, OF, TRADE con series no vacías
-    const unordered_set<string> required_sides = {"BI","OF","TRADE"};
-    vector<string> eligible;
-    eligible.reserve(all_series.size());
-    for (const auto& kv : all_series) {
-        const string& inst = kv.first;
-        const auto& sides_map = kv.second;
-
-        bool has_all = true;
-        for (const auto& rs : required_sides) {
-            auto it = sides_map.find(rs);
-            if (it==sides_map.end()) { has_all=false; break; }
-            const auto& sp = it->second;
-            // serie no vacía: al menos un vwap válido
-            if (sp.vwap.empty()) { has_all=false; break; }
-        }
-        if (has_all) eligible.push_back(inst);
+    // 4) Escribir df_all.csv (con --book: bid/ask/mid/microprice/quote_spread/imbalance as-of en cada fila)
+    vector<BookFeat> book;
+    if (popt.book) book = build_book_features(df_all);
+    if (!write_df_all("df_all.csv", df_all, popt.book? &book : nullptr)) {
+        cerr << "No se pudo escribir df_all.csv\n";
+        return 1;
     }
-    sort(eligible.begin(), eligible.end());
 
-    // 6) Mostrar resumen
+    // 5) Mostrar resumen
     cerr << "DF global escrito en: df_all.csv (rows=" << df_all.size() << ")\n";
     cout << "selected_instruments:\n";
     for (const auto& s : eligible) cout << s << "\n";
@@ -0,0 +1,360 @@
+// replay.cpp — reproduce market_data/ tick a tick y mide la latencia tick -> prediccion.
+// Fuente (merge por fecha_nano, tiempo real / acelerado / lo mas rapido posible)
+//   -> [SPSC] -> agrupado incremental por (instrumento, side, fecha_nano) con VWAP
+//   -> [SPSC] -> features (rectas de k_last puntos, igual que get_nowcast)
+//   -> [SPSC] -> forward MLP.
+// Cada mensaje lleva el instante (steady_clock, ns) en que paso por cada etapa; al final se
+// imprime el histograma por etapa y el total fuente -> prediccion.
+#include <bits/stdc++.h>
+#include "market_core.hpp"
+#include "nowcast_core.hpp"
+#include "mlp_core.hpp"
+#include "latency.hpp"
+#include "drift_monitor.hpp"
+using namespace std;
+
+/* ---------------- cola SPSC lock-free ---------------- */
+// Un productor, un consumidor. Capacidad potencia de 2; push/pop esperan activamente
+// (con yield) si la cola esta llena/vacia, asi la contrapresion queda en la latencia medida.
+template<class T, size_t N>
+class SpscQueue {
+    static_assert((N & (N-1))==0, "N debe ser potencia de 2");
+public:
+    void push(const T& v){
+        size_t h = head_.load(memory_order_relaxed);
+        while(h - tail_cache_ >= N){
+            tail_cache_ = tail_.load(memory_order_acquire);
+            if(h - tail_cache_ >= N) this_thread::yield();
+        }
+        buf_[h & (N-1)] = v;
+        head_.store(h+1, memory_order_release);
+    }
+    void pop(T& out){
+        size_t t = tail_.load(memory_order_relaxed);
+        while(t == head_cache_){
+            head_cache_ = head_.load(memory_order_acquire);
+            if(t == head_cache_) this_thread::yield();
+        }
+        out = buf_[t & (N-1)];
+        tail_.store(t+1, memory_order_release);
+    }
+private:
+    alignas(64) atomic<size_t> head_{0};
+    alignas(64) size_t tail_cache_ = 0;     // solo productor
+    alignas(64) atomic<size_t> tail_{0};
+    alignas(64) size_t head_cache_ = 0;     // solo consumidor
+    alignas(64) array<T, N> buf_;
+};
+
+/* ---------------- mensajes ---------------- */
+enum : uint8_t { SIDE_BI=0, SIDE_OF=1, SIDE_TRADE=2, SIDE_OTHER=3 };
+
+struct Tick {
+    long long fecha_nano;
+    double price, qty;
+    uint16_t inst;
+    uint8_t side;
+};
+struct TickMsg {
+    Tick tk;
+    int64_t t_src;
+    bool eos;
+};
+// t_last: llegada del ultimo tick del grupo; t_src: llegada del tick que lo cierra (ver grouper)
+struct GroupMsg {
+    long long fecha_nano;
+    double vwap;
+    uint16_t inst;
+    int64_t t_last, t_src, t_group;   // now_ns()
+    bool eos;
+};
+static constexpr int MAX_FEATS = 32;
+struct FeatMsg {
+    double x[MAX_FEATS];
+    double t0;
+    double y_prev;   // y realizado de la prediccion anterior (pendiente del target en este trade) o NaN
+    int64_t t_last, t_src, t_group, t_feat;
+    bool predict;    // false: solo lleva y_prev (las features de este trade no se pudieron ajustar)
+    bool eos;
+};
+struct Stamp { int64_t t_last, t_src, t_group, t_feat, t_pred; };
+
+static uint8_t side_id(const string& s){
+    if(s=="BI") return SIDE_BI;
+    if(s=="OF") return SIDE_OF;
+    if(s=="TRADE") return SIDE_TRADE;
+    return SIDE_OTHER;
+}
+
+static void print_stage(const string& name, vector<double> v){
+    sort(v.begin(), v.end());
+    cout<<"  "<<left<<setw(16)<<name<<right
+        <<" n="<<setw(8)<<v.size()
+        <<"  p50="<<setw(10)<<pct(v,50)/1e3<<"  p90="<<setw(10)<<pct(v,90)/1e3
+        <<"  p99="<<setw(10)<<pct(v,99)/1e3<<"  p99.9="<<setw(10)<<pct(v,99.9)/1e3
+        <<"  max="<<setw(10)<<(v.empty()? 0.0 : v.back()/1e3)<<"  us\n";
+    // histograma log2 en us
+    map<int,long long> h;
+    for(double x: v){ double us = x/1e3; h[us<1.0? 0 : (int)floor(log2(us))+1]++; }
+    cout<<"    hist(us):";
+    for(auto& kv: h) cout<<" ["<<(kv.first==0? 0 : 1<<(kv.first-1))<<","<<(1<<kv.first)<<"):"<<kv.second;
+    cout<<"\n";
+}
+
+int main(int argc, char** argv){
+    string dir = "./market_data";
+    string target;
+    int k_last = 3;
+    int top_others = 4;
+    string bundle_path = "mlp_bundle.txt";
+    double speed = 0.0;      // 0 = lo mas rapido posible, 1 = tiempo real, 10 = 10x
+    ActImpl act = ActImpl::Libm;
+    string pred_out;
+    DriftOpts drift;
+    string drift_out;
+
+    for(int i=1;i<argc;i++){
+        string a = argv[i];
+        auto need=[&](const char* name){ if(i+1>=argc){ cerr<<"Falta valor para "<<name<<"\n"; exit(1);} return string(argv[++i]); };
+        if(a=="--dir") dir = need("--dir");
+        else if(a=="--target") target = need("--target");
+        else if(a=="--k_last") k_last = stoi(need("--k_last"));
+        else if(a=="--top_others") top_others = stoi(need("--top_others"));
+        else if(a=="--bundle") bundle_path = need("--bundle");
+        else if(a=="--speed") speed = stod(need("--speed"));
+        else if(a=="--realtime") speed = 1.0;
+        else if(a=="--afap") speed = 0.0;
+        else if(a=="--pred_out") pred_out = need("--pred_out");
+        else if(a=="--drift") drift.every = stoll(need("--drift"));
+        else if(a=="--drift_window") drift.window = stoi(need("--drift_window"));
+        else if(a=="--drift_halflife") drift.halflife = stod(need("--drift_halflife"));
+        else if(a=="--drift_out") drift_out = need("--drift_out");
+        else if(a=="--act"){
+            string v = need("--act");
+            if(v=="libm") act = ActImpl::Libm;
+            else if(v=="fast") act = ActImpl::Fast;
+            else { cerr<<"--act debe ser libm|fast\n"; return 1; }
+        }
+        else { cerr<<"Arg desconocido: "<<a<<"\n"; return 1; }
+    }
+    if(target.empty()){ cerr<<"Debes pasar --target <instrumento>\n"; return 1; }
+
+    Bundle B;
+    try { B = load_bundle_txt(bundle_path); }
+    catch(const exception& ex){ cerr<<ex.what()<<"\n"; return 1; }
+
+    // ---- carga y merge por fecha_nano (fuera de la medicion) ----
+    vector<string> files; string err;
+    if(!list_market_files(dir, files, err)){ cerr<<err<<"\n"; return 1; }
+    unordered_map<string, vector<RawRow>> dfs;
+    load_market_files(files, dfs);
+    if(!dfs.count(target)){ cerr<<"Target instrument not found: "<<target<<"\n"; return 1; }
+
+    vector<string> inst_names;
+    for(const auto& kv: dfs) inst_names.push_back(kv.first);
+    sort(inst_names.begin(), inst_names.end());
+    vector<Tick> ticks;
+    // liquidez = #timestamps TRADE distintos con precio/cantidad validos (como los trades de get_nowcast)
+    vector<pair<string,int>> counts;
+    for(size_t id=0; id<inst_names.size(); ++id){
+        auto& rows = dfs[inst_names[id]];
+        stable_sort(rows.begin(), rows.end(), [](const RawRow& a, const RawRow& b){ return a.fecha_nano < b.fecha_nano; });
+        long long last = LLONG_MIN; int cnt = 0;
+        for(const auto& r: rows){
+            uint8_t s = side_id(r.side);
+            if(s==SIDE_TRADE && r.price>0.0 && r.quantity>0.0 && r.fecha_nano!=last){ ++cnt; last = r.fecha_nano; }
+            ticks.push_back({r.fecha_nano, r.price, r.quantity, (uint16_t)id, s});
+        }
+        counts.push_back({inst_names[id], cnt});
+    }
+    dfs.clear();
+    stable_sort(ticks.begin(), ticks.end(), [](const Tick& a, const Tick& b){ return a.fecha_nano < b.fecha_nano; });
+
+    // mismo criterio que select_instruments (empates por nombre)
+    sort(counts.begin(), counts.end(), [](auto& a, auto& b){
+        return a.second!=b.second? a.second>b.second : a.first<b.first;
+    });
+    vector<string> selected{target};
+    for(auto& pr: counts){
+        if((int)selected.size()>=1+top_others) break;
+        if(pr.first!=target) selected.push_back(pr.first);
+    }
+    const int K = (int)selected.size(), d = 2*K;
+    if(d > MAX_FEATS){
+        cerr<<"[ERROR] "<<K<<" instrumentos -> "<<d<<" features; replay admite hasta "<<MAX_FEATS
+            <<" (MAX_FEATS, "<<MAX_FEATS/2<<" instrumentos)\n";
+        return 1;
+    }
+    if(d != B.n_features){
+        cerr<<"[ERROR] features="<<d<<" ("<<K<<" instrumentos) != n_features del modelo "<<B.n_features<<"\n";
+        return 1;
+    }
+    // inst id -> posicion en selected (-1 si no se usa)
+    vector<int> sel_pos(inst_names.size(), -1);
+    for(int j=0;j<K;++j)
+        sel_pos[lower_bound(inst_names.begin(), inst_names.end(), selected[j]) - inst_names.begin()] = j;
+    const uint16_t target_id = (uint16_t)(lower_bound(inst_names.begin(), inst_names.end(), target) - inst_names.begin());
+
+    static SpscQueue<TickMsg, 1<<14>  q_ticks;
+    static SpscQueue<GroupMsg, 1<<12> q_groups;
+    static SpscQueue<FeatMsg, 1<<10>  q_feats;
+
+    // ---- fuente ----
+    thread source([&]{
+        const int64_t wall0 = now_ns();
+        const long long ts0 = ticks.empty()? 0 : ticks.front().fecha_nano;
+        for(const auto& tk: ticks){
+            if(speed>0.0){
+                const int64_t due = wall0 + (int64_t)((double)(tk.fecha_nano - ts0)/speed);
+                int64_t rem;
+                while((rem = due - now_ns()) > 0){
+                    if(rem > 200000) this_thread::sleep_for(chrono::nanoseconds(rem - 100000));
+                }
+            }
+            q_ticks.push({tk, now_ns(), false});
+        }
+        q_ticks.push({Tick{}, now_ns(), true});
+    });
+
+    // ---- agrupado incremental ----
+    // El CSV no marca el fin de un batch: un grupo (instrumento, side, fecha_nano) se cierra cuando
+    // llega el primer tick con fecha_nano posterior (o fin de stream). Su t_src es el de ese tick y
+    // t_last el de su ultimo tick: t_src - t_last es espera de datos (en --realtime, el hueco hasta el
+    // proximo tick de cualquier instrumento), no costo del pipeline, y se reporta aparte.
+    long long n_groups = 0;
+    thread grouper([&]{
+        struct Acc { double sumw=0, sumpw=0; int64_t t_last=0; bool open=false; };
+        vector<Acc> acc(inst_names.size());   // solo TRADE alimenta a features
+        vector<uint16_t> open_ids;
+        long long cur_ts = LLONG_MIN;
+        auto flush = [&](int64_t t_src){
+            // el target va ultimo para que sus features vean a los demas en el mismo timestamp
+            stable_partition(open_ids.begin(), open_ids.end(), [&](uint16_t id){ return id!=target_id; });
+            for(uint16_t id: open_ids){
+                Acc& a = acc[id];
+                if(a.sumw>0.0){
+                    q_groups.push({cur_ts, a.sumpw/a.sumw, id, a.t_last, t_src, now_ns(), false});
+                    ++n_groups;
+                }
+                a = Acc{};
+            }
+            open_ids.clear();
+        };
+        TickMsg m;
+        while(true){
+            q_ticks.pop(m);
+            if(m.eos){ flush(m.t_src); break; }
+            const Tick& tk = m.tk;
+            if(tk.fecha_nano != cur_ts){ flush(m.t_src); cur_ts = tk.fecha_nano; }
+            if(tk.side!=SIDE_TRADE || sel_pos[tk.inst]<0) continue;
+            if(!(isfinite(tk.price) && isfinite(tk.qty) && tk.price>0.0 && tk.qty>0.0)) continue;
+            Acc& a = acc[tk.inst];
+            if(!a.open){ a.open = true; open_ids.push_back(tk.inst); }
+            a.sumw += tk.qty; a.sumpw += tk.qty*tk.price;
+            a.t_last = m.t_src;
+        }
+        q_groups.push({0, 0.0, 0, now_ns(), now_ns(), now_ns(), true});
+    });
+
+    // ---- features ----
+    long long n_fit_fail = 0;
+    thread featurer([&]{
+        vector<vector<TP>> series(K);
+        for(auto& s: series) s.reserve(1<<16);
+        GroupMsg g;
+        bool prev_sent = false;   // el trade anterior del target genero una prediccion
+        while(true){
+            q_groups.pop(g);
+            if(g.eos) break;
+            int j = sel_pos[g.inst];
+            double t = (double)g.fecha_nano / 1e9;
+            series[j].push_back({t, g.vwap});
+            if(g.inst != target_id) continue;
+            FeatMsg f; f.eos = false; f.predict = true; f.t0 = t; f.y_prev = NaN;
+            bool ok = true;
+            for(int jj=0; jj<K && ok; ++jj){
+                double p=0.0, m=0.0;
+                ok = fit_line_lastk_at_t(series[jj], t, k_last, p, m);
+                f.x[jj]   = (jj==0)? g.vwap : p;
+                f.x[K+jj] = m;
+                // la pendiente del target aca es el m_next (label) de la prediccion anterior
+                if(jj==0 && ok && prev_sent) f.y_prev = m;
+            }
+            f.t_last = g.t_last; f.t_src = g.t_src; f.t_group = g.t_group; f.t_feat = now_ns();
+            prev_sent = ok;
+            if(!ok){
+                ++n_fit_fail;
+                if(isnan(f.y_prev)) continue;
+                f.predict = false;
+            }
+            q_feats.push(f);
+        }
+        FeatMsg end{}; end.eos = true;
+        q_feats.push(end);
+    });
+
+    // ---- inferencia ----
+    vector<Stamp> stamps; stamps.reserve(1<<16);
+    vector<pair<double,double>> preds;
+    ofstream drift_file;
+    if(!drift_out.empty()){
+        drift_file.open(drift_out);
+        if(!drift_file){ cerr<<"No se pudo abrir "<<drift_out<<"\n"; return 1; }
+    }
+    DriftMonitor dm(drift, drift_out.empty()? cerr : drift_file);
+    thread inferer([&]{
+        vector<double> x(d);
+        FeatMsg f;
+        double last_yhat = NaN;
+        while(true){
+            q_feats.pop(f);
+            if(f.eos) break;
+            if(drift.every && !isnan(f.y_prev)) dm.add(f.y_prev, last_yhat);
+            if(!f.predict) continue;
+            x.assign(f.x, f.x + d);
+            double yhat = mlp_predict(B, x, 1, act)[0];
+            stamps.push_back({f.t_last, f.t_src, f.t_group, f.t_feat, now_ns()});
+            preds.push_back({f.t0, yhat});
+            last_yhat = yhat;
+        }
+        if(drift.every && dm.count() % drift.every) dm.report();
+    });
+
+    const int64_t wall0 = now_ns();
+    source.join(); grouper.join(); featurer.join(); inferer.join();
+    double wall_ms = (double)(now_ns() - wall0)/1e6;
+
+    if(!pred_out.empty()){
+        ofstream fout(pred_out);
+        fout.setf(std::ios::fixed); fout<<setprecision(10);
+        fout<<"t0,yhat\n";
+        for(auto& p: preds) fout<<p.first<<","<<p.second<<"\n";
+    }
+
+    vector<double> s_wait, s_group, s_feat, s_pred, s_total, s_last;
+    for(const auto& s: stamps){
+        s_wait.push_back((double)(s.t_src - s.t_last));
+        s_group.push_back((double)(s.t_group - s.t_src));
+        s_feat.push_back((double)(s.t_feat - s.t_group));
+        s_pred.push_back((double)(s.t_pred - s.t_feat));
+        s_total.push_back((double)(s.t_pred - s.t_src));
+        s_last.push_back((double)(s.t_pred - s.t_last));
+    }
+    cout.setf(std::ios::fixed); cout<<setprecision(2);
+    cout<<"instrumentos: ";
+    for(int j=0;j<K;++j) cout<<(j? ", ":"")<<selected[j];
+    cout<<"\nticks="<<ticks.size()<<"  grupos TRADE="<<n_groups<<"  predicciones="<<preds.size()
+        <<"  fits fallidos="<<n_fit_fail<<"\n";
+    cout<<"modo="<<(speed>0.0? (speed==1.0? string("tiempo real") : "x" + to_string(speed)) : string("afap"))
+        <<"  wall="<<wall_ms<<" ms  ("<<(wall_ms>0? ticks.size()/wall_ms*1e3 : 0.0)<<" ticks/s)\n";
+    cout<<"espera de cierre (ultimo tick del grupo -> tick que lo cierra; depende de los datos):\n";
+    print_stage("last->close", s_wait);
+    cout<<"latencia por etapa desde el tick que cierra el grupo (incluye espera en cola):\n";
+    print_stage("src->group", s_group);
+    print_stage("group->feat", s_feat);
+    print_stage("feat->pred", s_pred);
+    print_stage("src->pred", s_total);
+    cout<<"total desde el ultimo tick del grupo (espera de cierre + pipeline):\n";
+    print_stage("last->pred", s_last);
+    return 0;
+}
@@ -0,0 +1,311 @@
+// tick_archive.hpp — formato binario compacto para los CSV de market_data/ (.tka).
+//
+// Layout (little-endian):
+//   header : "TKA1" | u32 version | u32 price_dec | u32 qty_dec | [v2: u64 src_size | i64 src_mtime]
+//            | u8 n_sides | n_sides x (u8 len, bytes) | u64 n_rows | u32 n_blocks | u64 index_offset
+//   bloques: varint n
+//            fecha_nano : zigzag-varint del primero, luego zigzag-varint de los deltas
+//            price      : entero escalado (x 10^price_dec), mismo esquema delta que fecha_nano
+//            quantity   : entero escalado (x 10^qty_dec), zigzag-varint sin delta
+//            side       : 2 bits por fila (indice en el diccionario del header)
+//   indice : por bloque u64 offset | u32 n_rows | u32 bytes | i64 min_ts | i64 max_ts
+//
+// Los decimales se eligen al convertir como el minimo que reproduce exactamente cada double
+// leido del CSV (k / 10^dec == valor); si no existe uno <= 9 la conversion falla.
+// src_size/src_mtime (v2) son tamaño y mtime del CSV de origen al convertir (0 = desconocido): con
+// ellos list_market_files descarta un .tka que quedo viejo respecto de su CSV. v1 no los tiene.
+// Las filas son las mismas que devuelve read_csv_minimal, en el mismo orden. Las funciones son
+// plantillas sobre la fila (RawRow: {fecha_nano, price, quantity, side}) para no depender de market_core.
+#pragma once
+#include "csv_util.hpp"
+#include "trace.hpp"
+#include <filesystem>
+
+static const char TKA_MAGIC[4] = {'T','K','A','1'};
+static const uint32_t TKA_VERSION = 2;
+static const int TKA_BLOCK_ROWS = 1<<16;
+
+// tamaño y mtime (en unidades de file_clock) de un archivo; {0,0} si no se puede leer
+struct TkaSource {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    bool known() const { return size!=0 || mtime!=0; }
+    bool operator==(const TkaSource& o) const { return size==o.size && mtime==o.mtime; }
+};
+static inline TkaSource tka_source_of(const string& path){
+    std::error_code ec;
+    TkaSource s;
+    auto sz = std::filesystem::file_size(path, ec);
+    if(ec) return s;
+    auto mt = std::filesystem::last_write_time(path, ec);
+    if(ec) return s;
+    s.size = (uint64_t)sz;
+    s.mtime = (int64_t)mt.time_since_epoch().count();
+    return s;
+}
+
+struct TkaBlockInfo {
+    uint64_t offset;
+    uint32_t n_rows, bytes;
+    int64_t min_ts, max_ts;
+};
+
+/* ---------------- varint / zigzag ---------------- */
+static inline void put_varint(vector<uint8_t>& out, uint64_t v){
+    while(v >= 0x80){ out.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+    out.push_back((uint8_t)v);
+}
+// false si el varint no termina antes de end o tiene mas de 10 bytes
+static inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v){
+    v = 0;
+    for(int shift=0; shift<64 && p<end; shift+=7){
+        const uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if(!(b & 0x80)) return true;
+    }
+    return false;
+}
+static inline uint64_t zigzag(int64_t v){ return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static inline int64_t unzigzag(uint64_t v){ return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+template<class T> static inline void put_raw(vector<uint8_t>& out, T v){
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(&v);
+    out.insert(out.end(), b, b + sizeof(T));
+}
+template<class T> static inline T get_raw(const uint8_t*& p){
+    T v; memcpy(&v, p, sizeof(T)); p += sizeof(T); return v;
+}
+
+static const double TKA_POW10[10] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9};
+
+// minimo dec tal que llround(x*10^dec)/10^dec == x para todos; -1 si no hay
+template<class Row>
+static inline int tka_pick_decimals(const vector<Row>& rows, bool price){
+    for(int dec=0; dec<=9; ++dec){
+        bool ok = true;
+        for(const auto& r: rows){
+            double x = price? r.price : r.quantity;
+            double s = x * TKA_POW10[dec];
+            if(fabs(s) > 9e15){ ok = false; break; }
+            if((double)llround(s) / TKA_POW10[dec] != x){ ok = false; break; }
+        }
+        if(ok) return dec;
+    }
+    return -1;
+}
+
+/* ---------------- escritura ---------------- */
+// src: tamaño/mtime del CSV de origen (tka_source_of), o desconocido
+template<class Row>
+static inline bool write_tka(const string& path, const vector<Row>& rows, string& err, const TkaSource& src = TkaSource()){
+    int pdec = tka_pick_decimals(rows, true), qdec = tka_pick_decimals(rows, false);
+    if(pdec<0 || qdec<0){ err = "precios/cantidades sin representacion decimal exacta (<= 9 decimales)"; return false; }
+
+    vector<string> sides;
+    vector<uint8_t> side_ix(rows.size());
+    for(size_t i=0;i<rows.size();++i){
+        auto it = find(sides.begin(), sides.end(), rows[i].side);
+        if(it==sides.end()){
+            if(sides.size()==4){ err = "mas de 4 valores distintos de side"; return false; }
+            sides.push_back(rows[i].side);
+            it = sides.end()-1;
+        }
+        side_ix[i] = (uint8_t)(it - sides.begin());
+    }
+
+    vector<uint8_t> out;
+    out.insert(out.end(), TKA_MAGIC, TKA_MAGIC+4);
+    put_raw<uint32_t>(out, TKA_VERSION);
+    put_raw<uint32_t>(out, (uint32_t)pdec);
+    put_raw<uint32_t>(out, (uint32_t)qdec);
+    put_raw<uint64_t>(out, src.size);
+    put_raw<int64_t>(out, src.mtime);
+    out.push_back((uint8_t)sides.size());
+    for(const auto& s: sides){ out.push_back((uint8_t)s.size()); out.insert(out.end(), s.begin(), s.end()); }
+    put_raw<uint64_t>(out, rows.size());
+    const uint32_t n_blocks = (uint32_t)((rows.size() + TKA_BLOCK_ROWS - 1) / TKA_BLOCK_ROWS);
+    put_raw<uint32_t>(out, n_blocks);
+    const size_t index_off_pos = out.size();
+    put_raw<uint64_t>(out, 0);
+
+    vector<TkaBlockInfo> index;
+    for(size_t b0=0; b0<rows.size(); b0+=TKA_BLOCK_ROWS){
+        const size_t n = min((size_t)TKA_BLOCK_ROWS, rows.size() - b0);
+        TkaBlockInfo bi{out.size(), (uint32_t)n, 0, LLONG_MAX, LLONG_MIN};
+        put_varint(out, n);
+        int64_t prev = 0;
+        for(size_t i=0;i<n;++i){
+            int64_t t = rows[b0+i].fecha_nano;
+            put_varint(out, zigzag(t - prev)); prev = t;
+            bi.min_ts = min<int64_t>(bi.min_ts, t); bi.max_ts = max<int64_t>(bi.max_ts, t);
+        }
+        prev = 0;
+        for(size_t i=0;i<n;++i){
+            int64_t k = llround(rows[b0+i].price * TKA_POW10[pdec]);
+            put_varint(out, zigzag(k - prev)); prev = k;
+        }
+        for(size_t i=0;i<n;++i) put_varint(out, zigzag(llround(rows[b0+i].quantity * TKA_POW10[qdec])));
+        for(size_t i=0;i<n;i+=4){
+            uint8_t packed = 0;
+            for(size_t j=0;j<4 && i+j<n;++j) packed |= side_ix[b0+i+j] << (2*j);
+            out.push_back(packed);
+        }
+        bi.bytes = (uint32_t)(out.size() - bi.offset);
+        index.push_back(bi);
+    }
+    const uint64_t index_off = out.size();
+    for(const auto& bi: index){
+        put_raw<uint64_t>(out, bi.offset);
+        put_raw<uint32_t>(out, bi.n_rows);
+        put_raw<uint32_t>(out, bi.bytes);
+        put_raw<int64_t>(out, bi.min_ts);
+        put_raw<int64_t>(out, bi.max_ts);
+    }
+    memcpy(&out[index_off_pos], &index_off, sizeof index_off);
+
+    ofstream fout(path, ios::binary);
+    if(!fout){ err = "No se pudo abrir " + path; return false; }
+    fout.write(reinterpret_cast<const char*>(out.data()), out.size());
+    if(!fout){ err = "Error escribiendo " + path; return false; }
+    return true;
+}
+
+/* ---------------- lectura ---------------- */
+// Header validado contra el tamaño del archivo; data_off es el inicio del primer bloque.
+struct TkaHeader {
+    uint32_t version = 0, pdec = 0, qdec = 0;
+    TkaSource src;
+    vector<string> sides;
+    uint64_t n_rows = 0;
+    uint32_t n_blocks = 0;
+    uint64_t index_off = 0;
+    size_t data_off = 0;
+};
+
+// base: los primeros avail bytes del archivo (al menos el header); size: tamaño total
+static inline bool parse_tka_header(const uint8_t* base, size_t avail, size_t size, TkaHeader& h, string& err){
+    const uint8_t* p = base;
+    const uint8_t* end = base + min(avail, size);
+    auto have = [&](size_t n){ return (size_t)(end - p) >= n; };
+    if(!have(16) || memcmp(p, TKA_MAGIC, 4)!=0){ err = "no es un archivo TKA"; return false; }
+    p += 4;
+    h.version = get_raw<uint32_t>(p);
+    if(h.version!=1 && h.version!=2){ err = "version TKA no soportada"; return false; }
+    h.pdec = get_raw<uint32_t>(p); h.qdec = get_raw<uint32_t>(p);
+    if(h.pdec>9 || h.qdec>9){ err = "decimales invalidos"; return false; }
+    if(h.version>=2){
+        if(!have(16)){ err = "header truncado"; return false; }
+        h.src.size = get_raw<uint64_t>(p); h.src.mtime = get_raw<int64_t>(p);
+    }
+    if(!have(1)){ err = "header truncado"; return false; }
+    const int n_sides = *p++;
+    if(n_sides > 4){ err = "diccionario de side invalido"; return false; }
+    h.sides.resize(n_sides);
+    for(auto& s: h.sides){
+        if(!have(1)){ err = "header truncado"; return false; }
+        const size_t len = *p++;
+        if(!have(len)){ err = "header truncado"; return false; }
+        s.assign(reinterpret_cast<const char*>(p), len); p += len;
+    }
+    if(!have(20)){ err = "header truncado"; return false; }
+    h.n_rows = get_raw<uint64_t>(p);
+    h.n_blocks = get_raw<uint32_t>(p);
+    h.index_off = get_raw<uint64_t>(p);
+    h.data_off = (size_t)(p - base);
+    if(h.n_blocks != (h.n_rows + TKA_BLOCK_ROWS - 1) / TKA_BLOCK_ROWS){ err = "n_rows/n_blocks inconsistentes"; return false; }
+    if(h.index_off < h.data_off || h.index_off > size || (size - h.index_off) / 32 < h.n_blocks){
+        err = "indice fuera del archivo"; return false;
+    }
+    return true;
+}
+
+// Solo el header (para ver src sin leer los bloques).
+static inline bool read_tka_header(const string& path, TkaHeader& h, string& err){
+    ifstream fin(path, ios::binary | ios::ate);
+    if(!fin){ err = "no se pudo abrir"; return false; }
+    const size_t size = (size_t)fin.tellg();
+    fin.seekg(0);
+    uint8_t buf[4+12+16+1+4*256+20];   // header mas largo posible
+    fin.read(reinterpret_cast<char*>(buf), sizeof buf);
+    return parse_tka_header(buf, (size_t)fin.gcount(), size, h, err);
+}
+
+// Lee las filas con fecha_nano en [ts_from, ts_to]; los bloques fuera de rango se saltean via el indice.
+// Cada largo (header, indice, bloque, varint) se valida contra el archivo: si algo no cierra devuelve
+// false sin agregar filas.
+template<class Row>
+static inline bool read_tka(const string& path, vector<Row>& out_rows,
+                            long long ts_from = LLONG_MIN, long long ts_to = LLONG_MAX){
+    TRACE_SCOPE("read_tka");
+    ifstream fin(path, ios::binary | ios::ate);
+    if(!fin) return false;
+    const size_t size = (size_t)fin.tellg();
+    fin.seekg(0);
+    vector<uint8_t> buf(size);
+    if(!fin.read(reinterpret_cast<char*>(buf.data()), size)) return false;
+
+    const size_t n0 = out_rows.size();
+    auto fail = [&](const string& why){
+        out_rows.resize(n0);
+        log_err("TKA invalido (" + why + "): " + path);
+        return false;
+    };
+    TkaHeader h;
+    string err;
+    if(!parse_tka_header(buf.data(), size, size, h, err)) return fail(err);
+    const int n_sides = (int)h.sides.size();
+
+    const double pscale = TKA_POW10[h.pdec], qscale = TKA_POW10[h.qdec];
+    out_rows.reserve(n0 + h.n_rows);
+    const uint8_t* ip = buf.data() + h.index_off;
+    vector<int64_t> ts, px;
+    uint64_t total = 0;
+    for(uint32_t b=0; b<h.n_blocks; ++b){
+        TkaBlockInfo bi;
+        bi.offset = get_raw<uint64_t>(ip); bi.n_rows = get_raw<uint32_t>(ip); bi.bytes = get_raw<uint32_t>(ip);
+        bi.min_ts = get_raw<int64_t>(ip);  bi.max_ts = get_raw<int64_t>(ip);
+        total += bi.n_rows;
+        if(bi.n_rows==0 || bi.n_rows > (uint32_t)TKA_BLOCK_ROWS) return fail("bloque con n_rows invalido");
+        if(bi.offset < h.data_off || bi.offset > h.index_off || bi.bytes > h.index_off - bi.offset)
+            return fail("bloque fuera del archivo");
+        if(bi.max_ts < ts_from || bi.min_ts > ts_to) continue;
+
+        const uint8_t* q = buf.data() + bi.offset;
+        const uint8_t* qend = q + bi.bytes;
+        uint64_t v;
+        if(!get_varint(q, qend, v) || v != bi.n_rows) return fail("n del bloque no coincide con el indice");
+        const size_t n = (size_t)v;
+        ts.resize(n); px.resize(n);
+        // acumulado en unsigned: un delta corrupto da basura pero no overflow con signo
+        uint64_t prev = 0;
+        for(size_t i=0;i<n;++i){
+            if(!get_varint(q, qend, v)) return fail("bloque truncado");
+            prev += (uint64_t)unzigzag(v); ts[i] = (int64_t)prev;
+            if(ts[i] < bi.min_ts || ts[i] > bi.max_ts) return fail("fecha_nano fuera del rango del indice");
+        }
+        prev = 0;
+        for(size_t i=0;i<n;++i){
+            if(!get_varint(q, qend, v)) return fail("bloque truncado");
+            prev += (uint64_t)unzigzag(v); px[i] = (int64_t)prev;
+        }
+        const size_t first = out_rows.size();
+        for(size_t i=0;i<n;++i){
+            if(!get_varint(q, qend, v)) return fail("bloque truncado");
+            out_rows.push_back({ts[i], (double)px[i] / pscale, (double)unzigzag(v) / qscale, string()});
+        }
+        if((size_t)(qend - q) < (n + 3) / 4) return fail("bloque truncado");
+        for(size_t i=0;i<n;++i){
+            int ix = (q[i>>2] >> (2*(i&3))) & 3;
+            if(ix >= n_sides) return fail("side fuera del diccionario");
+            out_rows[first+i].side = h.sides[ix];
+        }
+        if(ts_from!=LLONG_MIN || ts_to!=LLONG_MAX){
+            auto keep_end = remove_if(out_rows.begin()+first, out_rows.end(),
+                [&](const Row& r){ return r.fecha_nano < ts_from || r.fecha_nano > ts_to; });
+            out_rows.erase(keep_end, out_rows.end());
+        }
+    }
+    if(total != h.n_rows) return fail("n_rows del header no coincide con el indice");
+    TRACE_COUNTER("rows_parsed", out_rows.size() - n0);
+    return true;
+}
@@ -0,0 +1,75 @@
+// tick_pack.cpp — convierte los CSV de ticks de market_data/ al formato .tka (tick_archive.hpp).
+//   ./tick_pack --dir ./market_data [--out_dir DIR] [--verify]
+//   ./tick_pack archivo.csv [salida.tka] [--verify]
+// --verify relee cada .tka y lo compara fila a fila con read_csv_minimal.
+#include <bits/stdc++.h>
+#include <filesystem>
+#include "market_core.hpp"
+#include "tick_archive.hpp"
+using namespace std;
+namespace fs = std::filesystem;
+
+static bool same_rows(const vector<RawRow>& a, const vector<RawRow>& b){
+    if(a.size()!=b.size()) return false;
+    for(size_t i=0;i<a.size();++i)
+        if(a[i].fecha_nano!=b[i].fecha_nano || a[i].price!=b[i].price ||
+           a[i].quantity!=b[i].quantity || a[i].side!=b[i].side) return false;
+    return true;
+}
+
+static bool pack_one(const string& in, const string& out, bool verify){
+    const TkaSource src = tka_source_of(in);   // antes de leer: si el CSV cambia despues, el .tka queda viejo
+    vector<RawRow> rows;
+    if(!read_csv_minimal(in, rows)){ cerr<<"No se pudo leer "<<in<<"\n"; return false; }
+    string err;
+    if(!write_tka(out, rows, err, src)){ cerr<<in<<": "<<err<<"\n"; return false; }
+    const auto sz_in = fs::file_size(in), sz_out = fs::file_size(out);
+    cout<<in<<" -> "<<out<<": "<<rows.size()<<" filas, "<<sz_in<<" -> "<<sz_out<<" bytes (x"
+        <<fixed<<setprecision(1)<<(double)sz_in/max<uintmax_t>(sz_out,1)<<")\n";
+    if(verify){
+        vector<RawRow> back;
+        if(!read_tka(out, back) || !same_rows(rows, back)){ cerr<<"[ERROR] verificacion fallida: "<<out<<"\n"; return false; }
+    }
+    return true;
+}
+
+int main(int argc, char** argv){
+    string dir, out_dir;
+    vector<string> pos;
+    bool verify = false;
+    for(int i=1;i<argc;i++){
+        string a = argv[i];
+        auto need=[&](const char* name){ if(i+1>=argc){ cerr<<"Falta valor para "<<name<<"\n"; exit(1);} return string(argv[++i]); };
+        if(a=="--dir") dir = need("--dir");
+        else if(a=="--out_dir") out_dir = need("--out_dir");
+        else if(a=="--verify") verify = true;
+        else if(a.rfind("--",0)==0){ cerr<<"Arg desconocido: "<<a<<"\n"; return 1; }
+        else pos.push_back(a);
+    }
+
+    vector<pair<string,string>> jobs;
+    if(!dir.empty()){
+        if(out_dir.empty()) out_dir = dir;
+        try {
+            fs::create_directories(out_dir);
+            for(const auto& e: fs::directory_iterator(dir))
+                if(e.is_regular_file() && e.path().extension()==".csv")
+                    jobs.push_back({e.path().string(), (fs::path(out_dir) / e.path().stem()).string() + ".tka"});
+        } catch(const std::exception& ex){
+            cerr<<"Error leyendo el directorio: "<<ex.what()<<"\n";
+            return 1;
+        }
+        sort(jobs.begin(), jobs.end());
+    }else if(!pos.empty() && pos.size()<=2){
+        string out = pos.size()==2? pos[1] : fs::path(pos[0]).replace_extension(".tka").string();
+        jobs.push_back({pos[0], out});
+    }else{
+        cerr<<"Uso: "<<argv[0]<<" --dir market_data [--out_dir DIR] [--verify] | archivo.csv [salida.tka] [--verify]\n";
+        return 1;
+    }
+    if(jobs.empty()){ cerr<<"No hay CSVs en "<<dir<<"\n"; return 1; }
+
+    int failed = 0;
+    for(const auto& j: jobs) if(!pack_one(j.first, j.second, verify)) ++failed;
+    return failed? 1 : 0;
+}
@@ -0,0 +1,142 @@
+// trace.hpp — spans y contadores con export a Chrome/Perfetto (trace.json).
+// Se activa en compilacion con -DHFT_TRACE; sin el flag las macros no generan codigo.
+//
+//   TRACE_SCOPE("parse");              // span desde aca hasta el fin del bloque
+//   TRACE_COUNTER("rows_parsed", n);   // suma n al contador y emite una muestra
+//
+// Con HFT_TRACE cada hilo junta eventos en su propio buffer (sin locks en el camino caliente)
+// y al salir del proceso se escriben en $HFT_TRACE_FILE (default trace.json); se abre en
+// chrome://tracing o ui.perfetto.dev. Ademas se cuentan las allocations (operator new
+// reemplazado) y se emite el contador "allocs" al cerrar cada span. El reemplazo de
+// operator new requiere que trace.hpp quede en un solo .cpp por binario, como en todas
+// las herramientas del repo.
+#pragma once
+
+#ifndef HFT_TRACE
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)sizeof(value))
+
+#else
+
+#include <bits/stdc++.h>
+
+namespace hft_trace {
+
+struct Event {
+    const char* name;
+    char ph;          // 'X' span completo, 'C' contador
+    double ts_us;
+    double dur_us;    // 'X'
+    double value;     // 'C'
+};
+
+struct ThreadBuf {
+    int tid;
+    std::vector<Event> events;
+};
+
+inline std::atomic<long long>& alloc_count(){ static std::atomic<long long> c{0}; return c; }
+
+inline double now_us(){
+    static const auto t0 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+}
+
+class Registry {
+public:
+    static Registry& get(){ static Registry r; return r; }
+    ThreadBuf* new_buf(){
+        std::lock_guard<std::mutex> lk(mu_);
+        bufs_.push_back(std::make_unique<ThreadBuf>());
+        bufs_.back()->tid = (int)bufs_.size();
+        bufs_.back()->events.reserve(1<<14);
+        return bufs_.back().get();
+    }
+    // contadores globales: el valor emitido es el acumulado
+    double add(const char* name, double v){
+        std::lock_guard<std::mutex> lk(mu_);
+        return counters_[name] += v;
+    }
+    ~Registry(){ dump(); }
+private:
+    void dump(){
+        const char* env = std::getenv("HFT_TRACE_FILE");
+        std::string path = env? env : "trace.json";
+        FILE* f = std::fopen(path.c_str(), "w");
+        if(!f) return;
+        std::fprintf(f, "{\"traceEvents\":[\n");
+        bool first = true;
+        for(const auto& b: bufs_){
+            for(const auto& e: b->events){
+                std::fprintf(f, "%s", first? "" : ",\n");
+                first = false;
+                if(e.ph=='X')
+                    std::fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                                 e.name, b->tid, e.ts_us, e.dur_us);
+                else
+                    std::fprintf(f, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%.17g}}",
+                                 e.name, b->tid, e.ts_us, e.value);
+            }
+        }
+        std::fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        std::fclose(f);
+        std::fprintf(stderr, "[trace] escrito %s\n", path.c_str());
+    }
+    std::mutex mu_;
+    std::vector<std::unique_ptr<ThreadBuf>> bufs_;
+    std::map<std::string, double> counters_;
+};
+
+inline ThreadBuf& tbuf(){
+    thread_local ThreadBuf* b = Registry::get().new_buf();
+    return *b;
+}
+
+inline void counter(const char* name, double v){
+    double total = Registry::get().add(name, v);
+    tbuf().events.push_back({name, 'C', now_us(), 0.0, total});
+}
+
+class Scope {
+public:
+    explicit Scope(const char* name): name_(name), t0_(now_us()) {}
+    ~Scope(){
+        double t1 = now_us();
+        ThreadBuf& b = tbuf();
+        b.events.push_back({name_, 'X', t0_, t1 - t0_, 0.0});
+        b.events.push_back({"allocs", 'C', t1, 0.0, (double)alloc_count().load(std::memory_order_relaxed)});
+    }
+private:
+    const char* name_;
+    double t0_;
+};
+
+} // namespace hft_trace
+
+// allocations: cuenta cada operator new (un solo .cpp por binario incluye este header)
+void* operator new(std::size_t n){
+    hft_trace::alloc_count().fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t n){ return operator new(n); }
+// Los delete reemplazados liberan memoria que viene del operator new de arriba (malloc), pero al
+// inlinearlos GCC ve "new ... free()" en cada sitio de llamada y avisa -Wmismatched-new-delete:
+// el par es correcto por construccion, asi que se silencia solo aca.
+#pragma GCC diagnostic push
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+#define TRACE_CAT2(a,b) a##b
+#define TRACE_CAT(a,b) TRACE_CAT2(a,b)
+#define TRACE_SCOPE(name) hft_trace::Scope TRACE_CAT(trace_scope_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) hft_trace::counter(name, (double)(value))
+
+#endif